@@ -14,7 +14,7 @@ int main(){
     set<int> bc(ab);
     auto it = ab.begin();
 
-    set<int> ac(ab.begin(), ab.end());
+    set<int> ac(it, ab.end());
 
     for (auto item: ab){
         std::cout << item << std::endl;
@@ -0,0 +1,107 @@
+#ifndef STL_COMPATIBLE_SET_AGGREGATE_HPP
+#define STL_COMPATIBLE_SET_AGGREGATE_HPP
+
+#include <limits>
+
+
+//  Subtree aggregates for Tree. A policy describes a monoid over the keys:
+//
+//      using value_type = ...;
+//      value_type identity() const;
+//      value_type lift(const Key& key) const;
+//      value_type combine(const value_type& left, const value_type& right) const;
+//
+//  combine has to be associative, it does not need to be commutative: the
+//  values are always combined in key order. Every node caches the aggregate
+//  of its subtree, so a range query visits O(log n) nodes.
+//
+//  no_aggregate has a void value_type and costs nothing, not even a byte
+//  in the nodes.
+
+
+struct no_aggregate {
+    using value_type = void;
+};
+
+
+//  Projection used by the stock policies when the key itself is aggregated.
+struct project_key {
+    template <class Key>
+    const Key& operator()(const Key& key) const {
+        return key;
+    }
+};
+
+
+template <class T, class Project = project_key>
+struct sum_aggregate {
+    using value_type = T;
+    Project project;
+
+    value_type identity() const {
+        return T();
+    }
+
+    template <class Key>
+    value_type lift(const Key& key) const {
+        return project(key);
+    }
+
+    value_type combine(const value_type& left, const value_type& right) const {
+        return left + right;
+    }
+};
+
+
+template <class T, class Project = project_key>
+struct min_aggregate {
+    using value_type = T;
+    Project project;
+
+    value_type identity() const {
+        return std::numeric_limits<T>::max();
+    }
+
+    template <class Key>
+    value_type lift(const Key& key) const {
+        return project(key);
+    }
+
+    value_type combine(const value_type& left, const value_type& right) const {
+        return right < left ? right : left;
+    }
+};
+
+
+//  With a projection to the end of an interval keyed by its start, the
+//  maximum over the keys below a point tells whether any of them overlaps it.
+template <class T, class Project = project_key>
+struct max_aggregate {
+    using value_type = T;
+    Project project;
+
+    value_type identity() const {
+        return std::numeric_limits<T>::lowest();
+    }
+
+    template <class Key>
+    value_type lift(const Key& key) const {
+        return project(key);
+    }
+
+    value_type combine(const value_type& left, const value_type& right) const {
+        return left < right ? right : left;
+    }
+};
+
+
+//  Storage for the cached aggregate inside a node; empty for no_aggregate.
+template <class Value>
+struct aggregate_slot {
+    Value aggregate;
+};
+
+template <>
+struct aggregate_slot<void> {};
+
+#endif //STL_COMPATIBLE_SET_AGGREGATE_HPP
@@ -0,0 +1,307 @@
+#ifndef STL_COMPATIBLE_SET_BALANCE_HPP
+#define STL_COMPATIBLE_SET_BALANCE_HPP
+
+#include <cstddef>
+
+#define MAX_IMBALANCE (1)
+
+
+//  Balancing policies for Tree. Every policy is asked to restore its invariant
+//  at one node after a child subtree of it changed and returns the new root of
+//  that subtree. Node::height holds the AVL height for AVL policies and the
+//  rank plus one for the rank-balanced ones, so an empty subtree always has
+//  height 0 and a fresh leaf has height 1.
+//
+//  Rotations never touch heights, each policy maintains them itself.
+//
+//  Besides balance every policy tells Tree how to join two trees around a
+//  pivot (join_slack: how much taller one side may be before the pivot is
+//  pushed down its spine) and what height to give a node of a tree built
+//  from a sorted sequence (build_height).
+
+
+struct balance_base {
+protected:
+    template <class Tree>
+    static typename Tree::node_ptr rotate_left(Tree& tree, typename Tree::node_ptr node) {
+        return tree.left_rotate(node);
+    }
+
+    template <class Tree>
+    static typename Tree::node_ptr rotate_right(Tree& tree, typename Tree::node_ptr node) {
+        return tree.right_rotate(node);
+    }
+
+    //  Rank difference between a node and one of its children.
+    template <class Tree>
+    static long diff(Tree& tree, typename Tree::node_ptr node, typename Tree::node_ptr child) {
+        return long(tree.height(node)) - long(tree.height(child));
+    }
+
+    template <class Tree>
+    static typename Tree::node_ptr avl(Tree& tree, typename Tree::node_ptr node, long bound);
+
+public:
+    static size_t build_height(size_t left, size_t right, size_t) {
+        return (left > right ? left : right) + 1;
+    }
+};
+
+
+//  Height-balanced tree where the heights of sibling subtrees differ by at
+//  most MAX_IMBALANCE.
+struct avl_balance: balance_base {
+    template <class Tree>
+    typename Tree::node_ptr balance(Tree& tree, typename Tree::node_ptr node) const {
+        return avl(tree, node, MAX_IMBALANCE);
+    }
+
+    long join_slack() const {
+        return MAX_IMBALANCE;
+    }
+};
+
+
+//  AVL tree with a per-instance imbalance bound: larger bounds make the tree
+//  deeper but rotate less often under updates. The bound is capped at 8 so that
+//  heights keep fitting in the one byte a node has for them.
+class relaxed_avl_balance: balance_base {
+public:
+    explicit relaxed_avl_balance(long bound = 2):
+        bound_(bound < 1 ? 1 : bound > 8 ? 8 : bound)
+    {}
+
+    long bound() const {
+        return bound_;
+    }
+
+    template <class Tree>
+    typename Tree::node_ptr balance(Tree& tree, typename Tree::node_ptr node) const {
+        return avl(tree, node, bound_);
+    }
+
+    long join_slack() const {
+        return bound_;
+    }
+
+    using balance_base::build_height;
+
+private:
+    long bound_;
+};
+
+
+//  Red-black tree in rank form: rank differences are 0 (red child) or 1 and a
+//  0-child never has a 0-child. At most two rotations per insertion and three
+//  per erase.
+struct red_black_balance: balance_base {
+    template <class Tree>
+    typename Tree::node_ptr balance(Tree& tree, typename Tree::node_ptr node) const;
+
+    long join_slack() const {
+        return 0;
+    }
+
+    //  A tree split evenly at the middle gets rank floor(log2(size + 1)) - 1
+    //  everywhere, which leaves only the incomplete last level red.
+    static size_t build_height(size_t, size_t, size_t size) {
+        size_t height = 0;
+        for(++size; size > 1; size >>= 1){
+            ++height;
+        }
+        return height;
+    }
+
+private:
+    template <class Tree>
+    static typename Tree::node_ptr fix_short(Tree& tree, typename Tree::node_ptr node, bool left);
+};
+
+
+//  Weak AVL tree: rank differences are 1 or 2 and every leaf has rank 0. Behaves
+//  as an AVL tree under insertions only and performs at most two rotations per
+//  update.
+struct wavl_balance: balance_base {
+    template <class Tree>
+    typename Tree::node_ptr balance(Tree& tree, typename Tree::node_ptr node) const;
+
+    long join_slack() const {
+        return 1;
+    }
+};
+
+
+//  -------------------------------------------
+//  |       BALANCE POLICIES DEFINITIONS      |
+//  -------------------------------------------
+
+
+template<class Tree>
+typename Tree::node_ptr balance_base::avl(Tree &tree, typename Tree::node_ptr node, long bound) {
+    tree.fix_height(node);
+    if(tree.balance_factor(node) > bound){
+        if(tree.balance_factor(node->right) < 0){
+            auto right = rotate_right(tree, node->right);
+            tree.fix_height(right->right);
+            tree.fix_height(right);
+            node->right = right;
+        }
+        auto root = rotate_left(tree, node);
+        tree.fix_height(root->left);
+        tree.fix_height(root);
+        return root;
+    }
+    if(tree.balance_factor(node) < -bound){
+        if(tree.balance_factor(node->left) > 0){
+            auto left = rotate_left(tree, node->left);
+            tree.fix_height(left->left);
+            tree.fix_height(left);
+            node->left = left;
+        }
+        auto root = rotate_right(tree, node);
+        tree.fix_height(root->right);
+        tree.fix_height(root);
+        return root;
+    }
+    return node;
+}
+
+
+template<class Tree>
+typename Tree::node_ptr red_black_balance::balance(Tree &tree, typename Tree::node_ptr node) const {
+    //  insertion: a red child with a red child
+    if(diff(tree, node, node->left) == 0 && node->left &&
+       (diff(tree, node->left, node->left->left) == 0 || diff(tree, node->left, node->left->right) == 0)){
+        if(diff(tree, node, node->right) == 0){
+            ++node->height;
+            return node;
+        }
+        if(diff(tree, node->left, node->left->right) == 0 && diff(tree, node->left, node->left->left) != 0){
+            node->left = rotate_left(tree, node->left);
+        }
+        return rotate_right(tree, node);
+    }
+    if(diff(tree, node, node->right) == 0 && node->right &&
+       (diff(tree, node->right, node->right->right) == 0 || diff(tree, node->right, node->right->left) == 0)){
+        if(diff(tree, node, node->left) == 0){
+            ++node->height;
+            return node;
+        }
+        if(diff(tree, node->right, node->right->left) == 0 && diff(tree, node->right, node->right->right) != 0){
+            node->right = rotate_right(tree, node->right);
+        }
+        return rotate_left(tree, node);
+    }
+
+    //  erase: a child whose black height dropped
+    if(diff(tree, node, node->left) == 2){
+        return fix_short(tree, node, true);
+    }
+    if(diff(tree, node, node->right) == 2){
+        return fix_short(tree, node, false);
+    }
+    return node;
+}
+
+template<class Tree>
+typename Tree::node_ptr red_black_balance::fix_short(Tree &tree, typename Tree::node_ptr node, bool left) {
+    auto sibling = left ? node->right : node->left;
+
+    if(diff(tree, node, sibling) == 0){
+        auto root = left ? rotate_left(tree, node) : rotate_right(tree, node);
+        if(left){
+            root->left = fix_short(tree, root->left, true);
+        } else {
+            root->right = fix_short(tree, root->right, false);
+        }
+        return root;
+    }
+
+    auto outer = left ? sibling->right : sibling->left;
+    auto inner = left ? sibling->left : sibling->right;
+    if(diff(tree, sibling, outer) == 0){
+        auto root = left ? rotate_left(tree, node) : rotate_right(tree, node);
+        ++root->height;
+        --node->height;
+        return root;
+    }
+    if(diff(tree, sibling, inner) == 0){
+        if(left){
+            node->right = rotate_right(tree, node->right);
+        } else {
+            node->left = rotate_left(tree, node->left);
+        }
+        auto root = left ? rotate_left(tree, node) : rotate_right(tree, node);
+        ++root->height;
+        --node->height;
+        return root;
+    }
+    --node->height;
+    return node;
+}
+
+
+template<class Tree>
+typename Tree::node_ptr wavl_balance::balance(Tree &tree, typename Tree::node_ptr node) const {
+    if(!node->left && !node->right){
+        node->height = 1;
+        return node;
+    }
+
+    for(bool left: {true, false}){
+        auto& child = left ? node->left : node->right;
+        auto& sibling = left ? node->right : node->left;
+
+        if(diff(tree, node, child) == 0){
+            if(diff(tree, node, sibling) == 1){
+                ++node->height;
+                return node;
+            }
+            auto& outer = left ? child->left : child->right;
+            if(diff(tree, child, outer) == 1){
+                auto root = left ? rotate_right(tree, node) : rotate_left(tree, node);
+                --node->height;
+                return root;
+            }
+            auto middle = left ? child->right : child->left;
+            child = left ? rotate_left(tree, child) : rotate_right(tree, child);
+            auto root = left ? rotate_right(tree, node) : rotate_left(tree, node);
+            ++middle->height;
+            --(left ? middle->left : middle->right)->height;
+            --node->height;
+            return root;
+        }
+
+        if(diff(tree, node, child) == 3){
+            if(diff(tree, node, sibling) == 2){
+                --node->height;
+                return node;
+            }
+            auto outer = left ? sibling->right : sibling->left;
+            auto inner = left ? sibling->left : sibling->right;
+            if(diff(tree, sibling, outer) == 2 && diff(tree, sibling, inner) == 2){
+                --node->height;
+                --sibling->height;
+                return node;
+            }
+            if(diff(tree, sibling, outer) == 1){
+                auto root = left ? rotate_left(tree, node) : rotate_right(tree, node);
+                ++root->height;
+                --node->height;
+                if(!node->left && !node->right){
+                    node->height = 1;
+                }
+                return root;
+            }
+            sibling = left ? rotate_right(tree, sibling) : rotate_left(tree, sibling);
+            auto root = left ? rotate_left(tree, node) : rotate_right(tree, node);
+            root->height += 2;
+            node->height -= 2;
+            --(left ? root->right : root->left)->height;
+            return root;
+        }
+    }
+    return node;
+}
+
+#endif //STL_COMPATIBLE_SET_BALANCE_HPP
@@ -0,0 +1,268 @@
+#ifndef STL_COMPATIBLE_SET_BUFFERED_SET_HPP
+#define STL_COMPATIBLE_SET_BUFFERED_SET_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "set.hpp"
+
+
+//  Write-optimised set for insert-heavy phases. Updates are not applied to
+//  the tree one by one but appended to an in-memory buffer, in the manner of
+//  an LSM memtable or the message buffers of a B-epsilon tree:
+//
+//    - a short unsorted log takes every insert and erase in O(1);
+//    - when the log fills it is sorted and merged into a sorted run holding
+//      at most one pending update per key, the latest one;
+//    - when the run reaches buffer_capacity it is merged into the set as one
+//      sorted batch (set::merge_sorted), which for large batches relinks the
+//      whole tree in a single pass instead of rebalancing once per key.
+//
+//  Results stay exact. contains and count look at the log, then the run,
+//  then the set, and never merge; every other query merges the buffer first,
+//  so its iterators are invalidated by the next update that triggers a merge
+//  or by the next merging query.
+template <class Key, class Compare = std::less<Key>, class Balance = avl_balance, class Aggregate = no_aggregate>
+class buffered_set {
+public:
+    using base_type = set<Key, Compare, Balance, Aggregate>;
+    using iterator = typename base_type::iterator;
+
+    explicit buffered_set(size_t buffer_capacity = 1 << 14, const Compare& cmp = Compare());
+
+    void insert(const Key& key);
+    void erase(const Key& key);
+    bool contains(const Key& key) const;
+    size_t count(const Key& key) const;
+
+    iterator begin();
+    iterator end();
+    iterator find(const Key& key);
+    iterator lower_bound(const Key& key);
+    iterator upper_bound(const Key& key);
+    size_t size();
+    bool empty();
+    void clear();
+
+    //  Merges every pending update into the set.
+    void flush();
+    //  Merges and gives read access to the set for the rest of its API.
+    const base_type& merged();
+    //  Buffered updates, including superseded ones still in the log.
+    size_t pending() const;
+    size_t buffer_capacity() const;
+
+private:
+    static constexpr size_t log_capacity = 64;
+
+    struct update {
+        Key key;
+        bool erase;
+    };
+
+    base_type set_;
+    //  unsorted, oldest first
+    std::vector<update> log_;
+    //  sorted by key, one update per key
+    std::vector<update> run_;
+    size_t buffer_capacity_;
+    Compare cmp_;
+
+    void append(const Key& key, bool erase);
+    void fold_log();
+    //  Latest buffered update for key, null if there is none.
+    const update* pending_update(const Key& key) const;
+};
+
+
+//  ----------------------------------------
+//  |   BUFFERED SET METHODS DEFINITIONS   |
+//  ----------------------------------------
+
+
+template<class Key, class Compare, class Balance, class Aggregate>
+buffered_set<Key, Compare, Balance, Aggregate>::buffered_set(size_t buffer_capacity, const Compare &cmp):
+    set_(cmp), buffer_capacity_(std::max(buffer_capacity, log_capacity)), cmp_(cmp)
+{
+    log_.reserve(log_capacity);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void buffered_set<Key, Compare, Balance, Aggregate>::insert(const Key &key) {
+    append(key, false);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void buffered_set<Key, Compare, Balance, Aggregate>::erase(const Key &key) {
+    append(key, true);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool buffered_set<Key, Compare, Balance, Aggregate>::contains(const Key &key) const {
+    if(auto latest = pending_update(key)){
+        return !latest->erase;
+    }
+    return set_.contains(key);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+size_t buffered_set<Key, Compare, Balance, Aggregate>::count(const Key &key) const {
+    return contains(key) ? 1 : 0;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename buffered_set<Key, Compare, Balance, Aggregate>::iterator buffered_set<Key, Compare, Balance, Aggregate>::begin() {
+    flush();
+    return set_.begin();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename buffered_set<Key, Compare, Balance, Aggregate>::iterator buffered_set<Key, Compare, Balance, Aggregate>::end() {
+    flush();
+    return set_.end();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename buffered_set<Key, Compare, Balance, Aggregate>::iterator buffered_set<Key, Compare, Balance, Aggregate>::find(const Key &key) {
+    flush();
+    return set_.find(key);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename buffered_set<Key, Compare, Balance, Aggregate>::iterator buffered_set<Key, Compare, Balance, Aggregate>::lower_bound(const Key &key) {
+    flush();
+    return set_.lower_bound(key);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename buffered_set<Key, Compare, Balance, Aggregate>::iterator buffered_set<Key, Compare, Balance, Aggregate>::upper_bound(const Key &key) {
+    flush();
+    return set_.upper_bound(key);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+size_t buffered_set<Key, Compare, Balance, Aggregate>::size() {
+    flush();
+    return set_.size();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool buffered_set<Key, Compare, Balance, Aggregate>::empty() {
+    return size() == 0;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void buffered_set<Key, Compare, Balance, Aggregate>::clear() {
+    log_.clear();
+    run_.clear();
+    set_.clear();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void buffered_set<Key, Compare, Balance, Aggregate>::flush() {
+    fold_log();
+    if(run_.empty()){
+        return;
+    }
+    //  the run is sorted and unique, so both halves are as well
+    std::vector<Key> add;
+    std::vector<Key> drop;
+    for(auto& pending: run_){
+        (pending.erase ? drop : add).push_back(std::move(pending.key));
+    }
+    run_.clear();
+    set_.merge_sorted(add.data(), add.data() + add.size(), drop.data(), drop.data() + drop.size());
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+const typename buffered_set<Key, Compare, Balance, Aggregate>::base_type& buffered_set<Key, Compare, Balance, Aggregate>::merged() {
+    flush();
+    return set_;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+size_t buffered_set<Key, Compare, Balance, Aggregate>::pending() const {
+    return log_.size() + run_.size();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+size_t buffered_set<Key, Compare, Balance, Aggregate>::buffer_capacity() const {
+    return buffer_capacity_;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void buffered_set<Key, Compare, Balance, Aggregate>::append(const Key &key, bool erase) {
+    log_.push_back(update{key, erase});
+    if(log_.size() < log_capacity){
+        return;
+    }
+    fold_log();
+    if(run_.size() >= buffer_capacity_){
+        flush();
+    }
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void buffered_set<Key, Compare, Balance, Aggregate>::fold_log() {
+    if(log_.empty()){
+        return;
+    }
+    //  stable, so among updates of the same key the latest ends up last
+    auto by_key = [this](const update& a, const update& b){
+        return cmp_(a.key, b.key);
+    };
+    std::stable_sort(log_.begin(), log_.end(), by_key);
+    size_t kept = 0;
+    for(size_t i = 0; i < log_.size(); ++i){
+        if(i + 1 < log_.size() && !cmp_(log_[i].key, log_[i + 1].key)){
+            continue;
+        }
+        if(kept != i){
+            log_[kept] = std::move(log_[i]);
+        }
+        ++kept;
+    }
+    log_.resize(kept);
+
+    //  merge from the back, the log winning ties as the newer update
+    auto old_size = run_.size();
+    run_.resize(old_size + kept, update{log_.front().key, false});
+    auto from_run = run_.begin() + old_size;
+    auto from_log = log_.end();
+    auto out = run_.end();
+    while(from_log != log_.begin()){
+        if(from_run != run_.begin() && by_key(*(from_log - 1), *(from_run - 1))){
+            *--out = std::move(*--from_run);
+        } else if(from_run != run_.begin() && !by_key(*(from_run - 1), *(from_log - 1))){
+            --from_run;
+            *--out = std::move(*--from_log);
+        } else {
+            *--out = std::move(*--from_log);
+        }
+    }
+    //  ties leave a gap at the front when both runs held the key
+    run_.erase(run_.begin() + (from_run - run_.begin()), out);
+    log_.clear();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+const typename buffered_set<Key, Compare, Balance, Aggregate>::update*
+buffered_set<Key, Compare, Balance, Aggregate>::pending_update(const Key &key) const {
+    for(auto it = log_.rbegin(); it != log_.rend(); ++it){
+        if(!cmp_(it->key, key) && !cmp_(key, it->key)){
+            return &*it;
+        }
+    }
+    auto it = std::lower_bound(run_.begin(), run_.end(), key, [this](const update& pending, const Key& probe){
+        return cmp_(pending.key, probe);
+    });
+    if(it != run_.end() && !cmp_(key, it->key)){
+        return &*it;
+    }
+    return nullptr;
+}
+
+#endif //STL_COMPATIBLE_SET_BUFFERED_SET_HPP
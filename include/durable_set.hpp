@@ -0,0 +1,450 @@
+#ifndef STL_COMPATIBLE_SET_DURABLE_SET_HPP
+#define STL_COMPATIBLE_SET_DURABLE_SET_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "key_codec.hpp"
+#include "set.hpp"
+
+
+struct durable_options {
+    //  insert and erase return once their record is on disk; concurrent
+    //  callers share one fsync. Otherwise records are queued until commit()
+    //  or until group_bytes of them are waiting.
+    bool synchronous = true;
+    size_t group_bytes = 1 << 16;
+    //  The log is folded into a new snapshot once it is larger than both this
+    //  and the last snapshot, so checkpoints cost O(1) amortised per update.
+    size_t checkpoint_bytes = 1 << 22;
+};
+
+
+//  Set persisted at path: path.snapshot holds the keys as of the last
+//  checkpoint, path.wal every insert and erase since. Opening the set loads
+//  the snapshot and replays the log; a torn record at the end of the log,
+//  left by a crash during a write, is dropped. Replaying a log over a
+//  snapshot that already contains its effect yields the same set, so a crash
+//  between writing a snapshot and truncating the log is harmless as well.
+//
+//  All members are thread-safe. Failed file operations throw std::system_error.
+//  An update whose flush failed stays queued and is written again by the next
+//  commit or synchronous update; it only counts as durable once that succeeds.
+template <class Key, class Compare = std::less<Key>, class Balance = avl_balance>
+class durable_set {
+public:
+    explicit durable_set(const std::string& path, const durable_options& options = durable_options());
+    durable_set(const durable_set&) = delete;
+    ~durable_set();
+
+    durable_set& operator=(const durable_set&) = delete;
+
+    bool insert(const Key& key);
+    bool erase(const Key& key);
+    bool contains(const Key& key) const;
+    std::optional<Key> lower_bound(const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+    template <class Fn>
+    void for_each(Fn fn) const;
+
+    //  Makes every update so far durable.
+    void commit();
+    //  Writes a new snapshot and empties the log.
+    void checkpoint();
+    size_t log_bytes() const;
+
+private:
+    enum op: char { op_insert = 1, op_erase = 2 };
+
+    set<Key, Compare, Balance> keys_;
+    durable_options options_;
+    std::string path_;
+    int log_ = -1;
+    size_t log_bytes_ = 0;
+    size_t snapshot_bytes_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable flushed_;
+    std::string pending_;
+    uint64_t appended_ = 0;
+    uint64_t durable_ = 0;
+    bool flushing_ = false;
+    //  set when a failed flush could not be cut off the log again
+    bool broken_ = false;
+
+    void recover();
+    void append(op kind, const Key& key, std::unique_lock<std::mutex>& lock);
+    void await(uint64_t lsn, std::unique_lock<std::mutex>& lock);
+    void flush(std::unique_lock<std::mutex>& lock);
+    void write_snapshot();
+
+    static std::string read_file(const std::string& path);
+    static void write_all(int fd, const std::string& bytes);
+    static void sync_directory(const std::string& path);
+    [[noreturn]] static void fail(const std::string& what, int error = errno);
+};
+
+
+//  ----------------------------------------
+//  |   DURABLE SET METHODS DEFINITIONS    |
+//  ----------------------------------------
+
+
+template<class Key, class Compare, class Balance>
+durable_set<Key, Compare, Balance>::durable_set(const std::string &path, const durable_options &options):
+    options_(options), path_(path)
+{
+    recover();
+}
+
+template<class Key, class Compare, class Balance>
+durable_set<Key, Compare, Balance>::~durable_set() {
+    try {
+        commit();
+    } catch(...) {
+    }
+    ::close(log_);
+}
+
+template<class Key, class Compare, class Balance>
+bool durable_set<Key, Compare, Balance>::insert(const Key &key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto before = keys_.size();
+    keys_.insert(key);
+    if(keys_.size() == before){
+        return false;
+    }
+    append(op_insert, key, lock);
+    return true;
+}
+
+template<class Key, class Compare, class Balance>
+bool durable_set<Key, Compare, Balance>::erase(const Key &key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto before = keys_.size();
+    keys_.erase(key);
+    if(keys_.size() == before){
+        return false;
+    }
+    append(op_erase, key, lock);
+    return true;
+}
+
+template<class Key, class Compare, class Balance>
+bool durable_set<Key, Compare, Balance>::contains(const Key &key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return keys_.contains(key);
+}
+
+template<class Key, class Compare, class Balance>
+std::optional<Key> durable_set<Key, Compare, Balance>::lower_bound(const Key &key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keys_.lower_bound(key);
+    if(it == keys_.end()){
+        return std::nullopt;
+    }
+    return *it;
+}
+
+template<class Key, class Compare, class Balance>
+size_t durable_set<Key, Compare, Balance>::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return keys_.size();
+}
+
+template<class Key, class Compare, class Balance>
+bool durable_set<Key, Compare, Balance>::empty() const {
+    return size() == 0;
+}
+
+template<class Key, class Compare, class Balance>
+template<class Fn>
+void durable_set<Key, Compare, Balance>::for_each(Fn fn) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto& key: keys_){
+        fn(key);
+    }
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::commit() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    await(appended_, lock);
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::checkpoint() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(flushing_){
+        flushed_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    //  the snapshot covers the queued records as well, they are never written
+    write_snapshot();
+    if(::ftruncate(log_, 0) != 0 || ::fsync(log_) != 0){
+        fail("truncate " + path_ + ".wal");
+    }
+    pending_.clear();
+    durable_ = appended_;
+    log_bytes_ = 0;
+    broken_ = false;
+    flushed_.notify_all();
+}
+
+template<class Key, class Compare, class Balance>
+size_t durable_set<Key, Compare, Balance>::log_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return log_bytes_ + pending_.size();
+}
+
+
+//  ----------------------------------------
+//  |     INTERNAL DURABLE SET METHODS     |
+//  ----------------------------------------
+
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::recover() {
+    //  snapshot: key count, keys, checksum of everything before it
+    auto snapshot = read_file(path_ + ".snapshot");
+    if(!snapshot.empty()){
+        uint32_t expected;
+        uint64_t count;
+        if(snapshot.size() < sizeof(count) + sizeof(expected)){
+            fail("truncated " + path_ + ".snapshot", EIO);
+        }
+        const char* first = snapshot.data();
+        const char* last = first + snapshot.size() - sizeof(expected);
+        std::memcpy(&expected, last, sizeof(expected));
+        if(checksum(first, last) != expected){
+            fail("corrupt " + path_ + ".snapshot", EIO);
+        }
+        std::memcpy(&count, first, sizeof(count));
+        first += sizeof(count);
+        std::vector<Key> keys(count);
+        for(auto& key: keys){
+            if(!key_codec<Key>::decode(first, last, key)){
+                fail("corrupt " + path_ + ".snapshot", EIO);
+            }
+        }
+        keys_ = set<Key, Compare, Balance>(keys.begin(), keys.end());
+        snapshot_bytes_ = snapshot.size();
+    }
+
+    //  log record: op, payload length, payload, checksum of the three
+    auto log = read_file(path_ + ".wal");
+    const char* first = log.data();
+    const char* last = first + log.size();
+    while(true){
+        uint32_t length;
+        uint32_t expected;
+        size_t header = 1 + sizeof(length);
+        if(size_t(last - first) < header){
+            break;
+        }
+        std::memcpy(&length, first + 1, sizeof(length));
+        if(size_t(last - first) - header < size_t(length) + sizeof(expected)){
+            break;
+        }
+        const char* payload = first + header;
+        const char* end = payload + length;
+        std::memcpy(&expected, end, sizeof(expected));
+        Key key;
+        if(checksum(first, end) != expected || !key_codec<Key>::decode(payload, end, key)){
+            break;
+        }
+        if(*first == op_insert){
+            keys_.insert(key);
+        } else {
+            keys_.erase(key);
+        }
+        first = end + sizeof(expected);
+    }
+    log_bytes_ = first - log.data();
+
+    log_ = ::open((path_ + ".wal").c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(log_ < 0){
+        fail("open " + path_ + ".wal");
+    }
+    if(log_bytes_ != log.size() && (::ftruncate(log_, log_bytes_) != 0 || ::fsync(log_) != 0)){
+        fail("truncate " + path_ + ".wal");
+    }
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::append(op kind, const Key &key, std::unique_lock<std::mutex> &lock) {
+    auto start = pending_.size();
+    uint32_t length = 0;
+    pending_.push_back(kind);
+    pending_.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    key_codec<Key>::encode(key, pending_);
+    length = pending_.size() - start - 1 - sizeof(length);
+    std::memcpy(&pending_[start + 1], &length, sizeof(length));
+    uint32_t sum = checksum(pending_.data() + start, pending_.data() + pending_.size());
+    pending_.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+    auto lsn = ++appended_;
+
+    if(options_.synchronous || pending_.size() >= options_.group_bytes){
+        await(lsn, lock);
+    }
+    if(!flushing_ && log_bytes_ > std::max(options_.checkpoint_bytes, snapshot_bytes_)){
+        lock.unlock();
+        checkpoint();
+    }
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::await(uint64_t lsn, std::unique_lock<std::mutex> &lock) {
+    //  The first waiter finding no flush in progress becomes the leader and
+    //  writes everything queued so far, the others wait for it.
+    while(durable_ < lsn){
+        if(broken_){
+            fail("log " + path_ + ".wal left torn by a failed write", EIO);
+        }
+        if(!flushing_){
+            flush(lock);
+        } else {
+            flushed_.wait_for(lock, std::chrono::milliseconds(10));
+        }
+    }
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::flush(std::unique_lock<std::mutex> &lock) {
+    std::string batch;
+    batch.swap(pending_);
+    auto upto = appended_;
+    flushing_ = true;
+    lock.unlock();
+    try {
+        write_all(log_, batch);
+        if(::fdatasync(log_) != 0){
+            fail("sync " + path_ + ".wal");
+        }
+    } catch(...) {
+        //  cut off whatever part of the batch reached the log, so that later
+        //  records do not end up behind a torn one, and queue the batch again
+        //  in front of the records appended meanwhile for the next leader
+        lock.lock();
+        if(::ftruncate(log_, log_bytes_) != 0){
+            broken_ = true;
+        }
+        pending_.insert(0, batch);
+        flushing_ = false;
+        flushed_.notify_all();
+        throw;
+    }
+    lock.lock();
+    flushing_ = false;
+    durable_ = std::max(durable_, upto);
+    log_bytes_ += batch.size();
+    flushed_.notify_all();
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::write_snapshot() {
+    std::string bytes;
+    uint64_t count = keys_.size();
+    bytes.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for(auto& key: keys_){
+        key_codec<Key>::encode(key, bytes);
+    }
+    uint32_t sum = checksum(bytes.data(), bytes.data() + bytes.size());
+    bytes.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+
+    auto temporary = path_ + ".snapshot.tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0){
+        fail("open " + temporary);
+    }
+    try {
+        write_all(fd, bytes);
+        if(::fsync(fd) != 0){
+            fail("sync " + temporary);
+        }
+    } catch(...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    if(::rename(temporary.c_str(), (path_ + ".snapshot").c_str()) != 0){
+        fail("rename " + temporary);
+    }
+    sync_directory(path_);
+    snapshot_bytes_ = bytes.size();
+}
+
+template<class Key, class Compare, class Balance>
+std::string durable_set<Key, Compare, Balance>::read_file(const std::string &path) {
+    std::string bytes;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        if(errno == ENOENT){
+            return bytes;
+        }
+        fail("open " + path);
+    }
+    char buffer[1 << 16];
+    while(true){
+        auto read = ::read(fd, buffer, sizeof(buffer));
+        if(read < 0 && errno == EINTR){
+            continue;
+        }
+        if(read < 0){
+            ::close(fd);
+            fail("read " + path);
+        }
+        if(read == 0){
+            break;
+        }
+        bytes.append(buffer, read);
+    }
+    ::close(fd);
+    return bytes;
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::write_all(int fd, const std::string &bytes) {
+    size_t done = 0;
+    while(done < bytes.size()){
+        auto written = ::write(fd, bytes.data() + done, bytes.size() - done);
+        if(written < 0 && errno == EINTR){
+            continue;
+        }
+        if(written < 0){
+            fail("write");
+        }
+        done += written;
+    }
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::sync_directory(const std::string &path) {
+    auto slash = path.rfind('/');
+    auto directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd >= 0){
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+template<class Key, class Compare, class Balance>
+void durable_set<Key, Compare, Balance>::fail(const std::string &what, int error) {
+    throw std::system_error(error, std::generic_category(), "durable_set: " + what);
+}
+
+#endif //STL_COMPATIBLE_SET_DURABLE_SET_HPP
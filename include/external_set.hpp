@@ -0,0 +1,937 @@
+#ifndef STL_COMPATIBLE_SET_EXTERNAL_SET_HPP
+#define STL_COMPATIBLE_SET_EXTERNAL_SET_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+//  Fixed number of page frames caching a file. Pages are pinned while in use
+//  and unpinned ones are evicted in clock order, dirty ones written back
+//  first. Pages past the end of the file read as zeros.
+class buffer_pool {
+public:
+    //  Pin on one page, released on destruction.
+    class page {
+    public:
+        page() = default;
+        page(const page&) = delete;
+        page(page&& other) noexcept;
+        ~page();
+
+        page& operator=(const page&) = delete;
+        page& operator=(page&& other) noexcept;
+
+        uint64_t id() const;
+        const char* data() const;
+        //  Marks the page dirty.
+        char* write();
+
+    private:
+        page(buffer_pool* pool, size_t frame, uint64_t id);
+        buffer_pool* pool_ = nullptr;
+        size_t frame_ = 0;
+        uint64_t id_ = 0;
+
+        friend class buffer_pool;
+    };
+
+    buffer_pool(const std::string& path, size_t page_size, size_t frames);
+    buffer_pool(const buffer_pool&) = delete;
+    ~buffer_pool();
+
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    size_t page_size() const;
+    //  Number of pages in the file, including ones only cached so far.
+    uint64_t pages() const;
+    page pin(uint64_t id);
+    //  Appends a zeroed page to the file.
+    page extend();
+    //  Writes every dirty page back.
+    void flush();
+    size_t reads() const;
+    size_t writes() const;
+
+private:
+    static constexpr uint64_t no_page = ~uint64_t(0);
+
+    struct frame {
+        uint64_t id = no_page;
+        std::unique_ptr<char[]> data;
+        unsigned pins = 0;
+        bool dirty = false;
+        bool referenced = false;
+    };
+
+    int fd_ = -1;
+    size_t page_size_;
+    uint64_t pages_;
+    std::vector<frame> frames_;
+    std::unordered_map<uint64_t, size_t> table_;
+    size_t hand_ = 0;
+    size_t reads_ = 0;
+    size_t writes_ = 0;
+
+    size_t victim();
+    void write_back(frame& target);
+    void unpin(size_t index);
+    [[noreturn]] static void fail(const std::string& what);
+};
+
+
+//  Ordered set stored in a file as a B+ tree of page-sized nodes, for key
+//  sets larger than memory. Only the pages in the buffer pool are held in
+//  RAM, so a lookup costs O(log_B n) page reads where B is the number of keys
+//  per page. Leaves are chained in key order for iteration.
+//
+//  Keys are stored bytewise and must be trivially copyable. Iterators are
+//  forward iterators holding a copy of their key; like set's they are
+//  invalidated by insert and erase. The file is brought up to date by
+//  flush() and on destruction, but is not crash-safe: see durable_set.
+template <class Key, class Compare = std::less<Key>>
+class external_set {
+    static_assert(std::is_trivially_copyable<Key>::value, "external_set stores keys bytewise");
+
+public:
+    struct options {
+        size_t page_size = 4096;
+        size_t pool_pages = 256;
+    };
+
+    class iterator {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = const Key;
+        using pointer = const Key*;
+        using reference = const Key&;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator() = default;
+
+        reference operator*() const;
+        pointer operator->() const;
+        iterator& operator++();
+        iterator operator++(int);
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        //  end() has leaf 0, the page of the file header
+        iterator(const external_set* set, uint64_t leaf, size_t slot);
+        const external_set* set_ = nullptr;
+        uint64_t leaf_ = 0;
+        size_t slot_ = 0;
+        Key key_{};
+
+        void settle();
+
+        friend class external_set;
+    };
+
+    explicit external_set(const std::string& path);
+    external_set(const std::string& path, const options& config, const Compare& cmp = Compare());
+    external_set(const external_set&) = delete;
+    ~external_set();
+
+    external_set& operator=(const external_set&) = delete;
+
+    iterator begin() const;
+    iterator end() const;
+
+    bool insert(const Key& key);
+    bool erase(const Key& key);
+
+    size_t size() const;
+    bool empty() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    bool contains(const Key& key) const;
+    size_t height() const;
+
+    void flush();
+    //  Page reads and writes the buffer pool issued so far.
+    size_t page_reads() const;
+    size_t page_writes() const;
+
+private:
+    struct node_header {
+        uint32_t leaf;
+        uint32_t count;
+        //  next leaf in key order; next free page for freed pages
+        uint64_t next;
+    };
+
+    struct file_header {
+        uint64_t magic;
+        uint64_t page_size;
+        uint64_t root;
+        uint64_t size;
+        uint64_t height;
+        uint64_t free;
+    };
+
+    static constexpr uint64_t magic = 0x74657365746e7865;  // "extntset"
+
+    mutable buffer_pool pool_;
+    Compare cmp_;
+    //  keys per leaf and per inner node
+    size_t leaf_capacity_;
+    size_t fanout_;
+    uint64_t root_ = 0;
+    size_t size_ = 0;
+    size_t height_ = 1;
+    uint64_t free_ = 0;
+
+    static node_header header(const char* page);
+    static void set_header(char* page, const node_header& header);
+    size_t key_offset(bool leaf) const;
+    Key key(const char* page, bool leaf, size_t index) const;
+    void set_key(char* page, bool leaf, size_t index, const Key& key) const;
+    static uint64_t child(const char* page, size_t index);
+    static void set_child(char* page, size_t index, uint64_t child);
+    //  memmove of keys or children inside one page or between two
+    void move_keys(char* to, size_t to_index, const char* from, size_t from_index, bool leaf, size_t count) const;
+    static void move_children(char* to, size_t to_index, const char* from, size_t from_index, size_t count);
+    size_t min_count(bool leaf) const;
+
+    //  first key index in a node not less than, resp. greater than key
+    size_t lower_index(const char* page, const Key& key) const;
+    size_t upper_index(const char* page, const Key& key) const;
+
+    buffer_pool::page allocate(bool leaf);
+    void release(buffer_pool::page&& page);
+    bool insert(uint64_t id, const Key& key, Key& separator, uint64_t& split);
+    bool erase(uint64_t id, const Key& key);
+    void fix_child(buffer_pool::page& parent, size_t index);
+};
+
+
+//  ----------------------------------------
+//  |     BUFFER POOL DEFINITIONS          |
+//  ----------------------------------------
+
+
+inline buffer_pool::page::page(buffer_pool *pool, size_t frame, uint64_t id):
+    pool_(pool), frame_(frame), id_(id)
+{}
+
+inline buffer_pool::page::page(page &&other) noexcept:
+    pool_(other.pool_), frame_(other.frame_), id_(other.id_)
+{
+    other.pool_ = nullptr;
+}
+
+inline buffer_pool::page::~page() {
+    if(pool_){
+        pool_->unpin(frame_);
+    }
+}
+
+inline buffer_pool::page &buffer_pool::page::operator=(page &&other) noexcept {
+    if(this != &other){
+        if(pool_){
+            pool_->unpin(frame_);
+        }
+        pool_ = other.pool_;
+        frame_ = other.frame_;
+        id_ = other.id_;
+        other.pool_ = nullptr;
+    }
+    return *this;
+}
+
+inline uint64_t buffer_pool::page::id() const {
+    return id_;
+}
+
+inline const char *buffer_pool::page::data() const {
+    return pool_->frames_[frame_].data.get();
+}
+
+inline char *buffer_pool::page::write() {
+    pool_->frames_[frame_].dirty = true;
+    return pool_->frames_[frame_].data.get();
+}
+
+
+inline buffer_pool::buffer_pool(const std::string &path, size_t page_size, size_t frames):
+    page_size_(page_size), frames_(std::max<size_t>(frames, 8))
+{
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd_ < 0){
+        fail("open " + path);
+    }
+    auto end = ::lseek(fd_, 0, SEEK_END);
+    if(end < 0){
+        ::close(fd_);
+        fail("seek " + path);
+    }
+    pages_ = (uint64_t(end) + page_size_ - 1) / page_size_;
+    for(auto& slot: frames_){
+        slot.data.reset(new char[page_size_]);
+    }
+}
+
+inline buffer_pool::~buffer_pool() {
+    try {
+        flush();
+    } catch(...) {
+    }
+    ::close(fd_);
+}
+
+inline size_t buffer_pool::page_size() const {
+    return page_size_;
+}
+
+inline uint64_t buffer_pool::pages() const {
+    return pages_;
+}
+
+inline buffer_pool::page buffer_pool::pin(uint64_t id) {
+    auto found = table_.find(id);
+    if(found != table_.end()){
+        auto& slot = frames_[found->second];
+        ++slot.pins;
+        slot.referenced = true;
+        return page(this, found->second, id);
+    }
+    auto index = victim();
+    auto& slot = frames_[index];
+    if(slot.id != no_page){
+        write_back(slot);
+        table_.erase(slot.id);
+        slot.id = no_page;
+    }
+    size_t done = 0;
+    while(done < page_size_){
+        auto read = ::pread(fd_, slot.data.get() + done, page_size_ - done, id * page_size_ + done);
+        if(read < 0 && errno == EINTR){
+            continue;
+        }
+        if(read < 0){
+            fail("read");
+        }
+        if(read == 0){
+            std::memset(slot.data.get() + done, 0, page_size_ - done);
+            break;
+        }
+        done += read;
+    }
+    ++reads_;
+    slot.id = id;
+    slot.pins = 1;
+    slot.referenced = true;
+    table_.emplace(id, index);
+    return page(this, index, id);
+}
+
+inline buffer_pool::page buffer_pool::extend() {
+    auto result = pin(pages_++);
+    std::memset(result.write(), 0, page_size_);
+    return result;
+}
+
+inline void buffer_pool::flush() {
+    for(auto& slot: frames_){
+        if(slot.id != no_page){
+            write_back(slot);
+        }
+    }
+}
+
+inline size_t buffer_pool::reads() const {
+    return reads_;
+}
+
+inline size_t buffer_pool::writes() const {
+    return writes_;
+}
+
+inline size_t buffer_pool::victim() {
+    //  clock: the hand clears reference bits until it finds an unpinned frame
+    //  that was not used since its last pass
+    for(size_t step = 0; step < 2 * frames_.size() + 1; ++step){
+        auto index = hand_;
+        hand_ = (hand_ + 1) % frames_.size();
+        auto& slot = frames_[index];
+        if(slot.pins > 0){
+            continue;
+        }
+        if(slot.referenced && slot.id != no_page){
+            slot.referenced = false;
+            continue;
+        }
+        return index;
+    }
+    throw std::runtime_error("buffer_pool: every frame is pinned");
+}
+
+inline void buffer_pool::write_back(frame &target) {
+    if(!target.dirty){
+        return;
+    }
+    size_t done = 0;
+    while(done < page_size_){
+        auto written = ::pwrite(fd_, target.data.get() + done, page_size_ - done, target.id * page_size_ + done);
+        if(written < 0 && errno == EINTR){
+            continue;
+        }
+        if(written < 0){
+            fail("write");
+        }
+        done += written;
+    }
+    ++writes_;
+    target.dirty = false;
+}
+
+inline void buffer_pool::unpin(size_t index) {
+    --frames_[index].pins;
+}
+
+inline void buffer_pool::fail(const std::string &what) {
+    throw std::system_error(errno, std::generic_category(), "buffer_pool: " + what);
+}
+
+
+//  ----------------------------------------
+//  |   EXTERNAL SET METHODS DEFINITIONS   |
+//  ----------------------------------------
+
+
+template<class Key, class Compare>
+external_set<Key, Compare>::external_set(const std::string &path):
+    external_set(path, options())
+{}
+
+template<class Key, class Compare>
+external_set<Key, Compare>::external_set(const std::string &path, const options &config, const Compare &cmp):
+    pool_(path, config.page_size, config.pool_pages), cmp_(cmp),
+    leaf_capacity_((config.page_size - sizeof(node_header)) / sizeof(Key)),
+    fanout_((config.page_size - sizeof(node_header) - sizeof(uint64_t)) / (sizeof(Key) + sizeof(uint64_t)))
+{
+    if(config.page_size < sizeof(file_header) || leaf_capacity_ < 4 || fanout_ < 4){
+        throw std::invalid_argument("external_set: page size too small for the key type");
+    }
+    if(pool_.pages() == 0){
+        pool_.extend();
+        root_ = allocate(true).id();
+        flush();
+        return;
+    }
+    auto first = pool_.pin(0);
+    file_header file;
+    std::memcpy(&file, first.data(), sizeof(file));
+    if(file.magic != magic || file.page_size != config.page_size){
+        throw std::invalid_argument("external_set: " + path + " is not a set with this page size");
+    }
+    root_ = file.root;
+    size_ = file.size;
+    height_ = file.height;
+    free_ = file.free;
+}
+
+template<class Key, class Compare>
+external_set<Key, Compare>::~external_set() {
+    try {
+        flush();
+    } catch(...) {
+    }
+}
+
+template<class Key, class Compare>
+typename external_set<Key, Compare>::iterator external_set<Key, Compare>::begin() const {
+    auto id = root_;
+    for(size_t level = 1; level < height_; ++level){
+        id = child(pool_.pin(id).data(), 0);
+    }
+    return iterator(this, id, 0);
+}
+
+template<class Key, class Compare>
+typename external_set<Key, Compare>::iterator external_set<Key, Compare>::end() const {
+    return iterator();
+}
+
+template<class Key, class Compare>
+bool external_set<Key, Compare>::insert(const Key &key) {
+    Key separator;
+    uint64_t split = 0;
+    if(!insert(root_, key, separator, split)){
+        return false;
+    }
+    ++size_;
+    if(split){
+        auto root = allocate(false);
+        auto data = root.write();
+        set_child(data, 0, root_);
+        set_child(data, 1, split);
+        set_key(data, false, 0, separator);
+        set_header(data, {0, 1, 0});
+        root_ = root.id();
+        ++height_;
+    }
+    return true;
+}
+
+template<class Key, class Compare>
+bool external_set<Key, Compare>::erase(const Key &key) {
+    if(!erase(root_, key)){
+        return false;
+    }
+    --size_;
+    auto root = pool_.pin(root_);
+    if(height_ > 1 && header(root.data()).count == 0){
+        root_ = child(root.data(), 0);
+        --height_;
+        release(std::move(root));
+    }
+    return true;
+}
+
+template<class Key, class Compare>
+size_t external_set<Key, Compare>::size() const {
+    return size_;
+}
+
+template<class Key, class Compare>
+bool external_set<Key, Compare>::empty() const {
+    return size_ == 0;
+}
+
+template<class Key, class Compare>
+typename external_set<Key, Compare>::iterator external_set<Key, Compare>::find(const Key &key) const {
+    auto it = lower_bound(key);
+    if(it != end() && cmp_(key, *it)){
+        return end();
+    }
+    return it;
+}
+
+template<class Key, class Compare>
+typename external_set<Key, Compare>::iterator external_set<Key, Compare>::lower_bound(const Key &key) const {
+    auto id = root_;
+    for(size_t level = 1; level < height_; ++level){
+        auto node = pool_.pin(id);
+        id = child(node.data(), upper_index(node.data(), key));
+    }
+    return iterator(this, id, lower_index(pool_.pin(id).data(), key));
+}
+
+template<class Key, class Compare>
+bool external_set<Key, Compare>::contains(const Key &key) const {
+    return find(key) != end();
+}
+
+template<class Key, class Compare>
+size_t external_set<Key, Compare>::height() const {
+    return height_;
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::flush() {
+    {
+        auto first = pool_.pin(0);
+        file_header file{magic, pool_.page_size(), root_, size_, height_, free_};
+        std::memcpy(first.write(), &file, sizeof(file));
+    }
+    pool_.flush();
+}
+
+template<class Key, class Compare>
+size_t external_set<Key, Compare>::page_reads() const {
+    return pool_.reads();
+}
+
+template<class Key, class Compare>
+size_t external_set<Key, Compare>::page_writes() const {
+    return pool_.writes();
+}
+
+
+//  ----------------------------------------
+//  |    INTERNAL EXTERNAL SET METHODS     |
+//  ----------------------------------------
+
+
+template<class Key, class Compare>
+typename external_set<Key, Compare>::node_header external_set<Key, Compare>::header(const char *page) {
+    node_header result;
+    std::memcpy(&result, page, sizeof(result));
+    return result;
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::set_header(char *page, const node_header &header) {
+    std::memcpy(page, &header, sizeof(header));
+}
+
+template<class Key, class Compare>
+size_t external_set<Key, Compare>::key_offset(bool leaf) const {
+    //  inner nodes keep fanout_ + 1 children in front of their keys
+    return sizeof(node_header) + (leaf ? 0 : (fanout_ + 1) * sizeof(uint64_t));
+}
+
+template<class Key, class Compare>
+Key external_set<Key, Compare>::key(const char *page, bool leaf, size_t index) const {
+    Key result;
+    std::memcpy(&result, page + key_offset(leaf) + index * sizeof(Key), sizeof(Key));
+    return result;
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::set_key(char *page, bool leaf, size_t index, const Key &key) const {
+    std::memcpy(page + key_offset(leaf) + index * sizeof(Key), &key, sizeof(Key));
+}
+
+template<class Key, class Compare>
+uint64_t external_set<Key, Compare>::child(const char *page, size_t index) {
+    uint64_t result;
+    std::memcpy(&result, page + sizeof(node_header) + index * sizeof(uint64_t), sizeof(result));
+    return result;
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::set_child(char *page, size_t index, uint64_t child) {
+    std::memcpy(page + sizeof(node_header) + index * sizeof(uint64_t), &child, sizeof(child));
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::move_keys(char *to, size_t to_index, const char *from, size_t from_index, bool leaf, size_t count) const {
+    auto offset = key_offset(leaf);
+    std::memmove(to + offset + to_index * sizeof(Key), from + offset + from_index * sizeof(Key), count * sizeof(Key));
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::move_children(char *to, size_t to_index, const char *from, size_t from_index, size_t count) {
+    std::memmove(to + sizeof(node_header) + to_index * sizeof(uint64_t),
+                 from + sizeof(node_header) + from_index * sizeof(uint64_t), count * sizeof(uint64_t));
+}
+
+template<class Key, class Compare>
+size_t external_set<Key, Compare>::min_count(bool leaf) const {
+    return (leaf ? leaf_capacity_ : fanout_) / 2;
+}
+
+template<class Key, class Compare>
+size_t external_set<Key, Compare>::lower_index(const char *page, const Key &key) const {
+    auto node = header(page);
+    size_t first = 0;
+    size_t last = node.count;
+    while(first < last){
+        auto middle = (first + last) / 2;
+        if(cmp_(this->key(page, node.leaf, middle), key)){
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+template<class Key, class Compare>
+size_t external_set<Key, Compare>::upper_index(const char *page, const Key &key) const {
+    auto node = header(page);
+    size_t first = 0;
+    size_t last = node.count;
+    while(first < last){
+        auto middle = (first + last) / 2;
+        if(!cmp_(key, this->key(page, node.leaf, middle))){
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+template<class Key, class Compare>
+buffer_pool::page external_set<Key, Compare>::allocate(bool leaf) {
+    auto page = free_ ? pool_.pin(free_) : pool_.extend();
+    if(free_){
+        free_ = header(page.data()).next;
+    }
+    set_header(page.write(), {leaf, 0, 0});
+    return page;
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::release(buffer_pool::page &&page) {
+    set_header(page.write(), {0, 0, free_});
+    free_ = page.id();
+}
+
+template<class Key, class Compare>
+bool external_set<Key, Compare>::insert(uint64_t id, const Key &key, Key &separator, uint64_t &split) {
+    //  Inserts below node id. A full node is split in half, the new right half
+    //  is returned in split together with the smallest key under it.
+    auto page = pool_.pin(id);
+    auto node = header(page.data());
+    if(node.leaf){
+        auto index = lower_index(page.data(), key);
+        if(index < node.count && !cmp_(key, this->key(page.data(), true, index))){
+            return false;
+        }
+        if(node.count < leaf_capacity_){
+            auto data = page.write();
+            move_keys(data, index + 1, data, index, true, node.count - index);
+            set_key(data, true, index, key);
+            set_header(data, {1, node.count + 1, node.next});
+            return true;
+        }
+        std::vector<Key> keys;
+        for(size_t i = 0; i < node.count; ++i){
+            keys.push_back(this->key(page.data(), true, i));
+        }
+        keys.insert(keys.begin() + index, key);
+        auto left_count = keys.size() / 2;
+        auto right_count = keys.size() - left_count;
+        auto right = allocate(true);
+        auto data = page.write();
+        auto right_data = right.write();
+        for(size_t i = 0; i < keys.size(); ++i){
+            if(i < left_count){
+                set_key(data, true, i, keys[i]);
+            } else {
+                set_key(right_data, true, i - left_count, keys[i]);
+            }
+        }
+        set_header(right_data, {1, uint32_t(right_count), node.next});
+        set_header(data, {1, uint32_t(left_count), right.id()});
+        separator = this->key(right_data, true, 0);
+        split = right.id();
+        return true;
+    }
+
+    auto index = upper_index(page.data(), key);
+    Key child_separator;
+    uint64_t child_split = 0;
+    if(!insert(child(page.data(), index), key, child_separator, child_split)){
+        return false;
+    }
+    if(!child_split){
+        return true;
+    }
+    auto data = page.write();
+    if(node.count < fanout_){
+        move_keys(data, index + 1, data, index, false, node.count - index);
+        move_children(data, index + 2, data, index + 1, node.count - index);
+        set_key(data, false, index, child_separator);
+        set_child(data, index + 1, child_split);
+        set_header(data, {0, node.count + 1, 0});
+        return true;
+    }
+    std::vector<Key> keys;
+    std::vector<uint64_t> children;
+    for(size_t i = 0; i < node.count; ++i){
+        keys.push_back(this->key(data, false, i));
+    }
+    for(size_t i = 0; i <= node.count; ++i){
+        children.push_back(child(data, i));
+    }
+    keys.insert(keys.begin() + index, child_separator);
+    children.insert(children.begin() + index + 1, child_split);
+    auto middle = keys.size() / 2;
+    auto right = allocate(false);
+    auto right_data = right.write();
+    for(size_t i = 0; i < keys.size(); ++i){
+        if(i < middle){
+            set_key(data, false, i, keys[i]);
+        } else if(i > middle){
+            set_key(right_data, false, i - middle - 1, keys[i]);
+        }
+    }
+    for(size_t i = 0; i < children.size(); ++i){
+        if(i <= middle){
+            set_child(data, i, children[i]);
+        } else {
+            set_child(right_data, i - middle - 1, children[i]);
+        }
+    }
+    set_header(data, {0, uint32_t(middle), 0});
+    set_header(right_data, {0, uint32_t(keys.size() - middle - 1), 0});
+    separator = keys[middle];
+    split = right.id();
+    return true;
+}
+
+template<class Key, class Compare>
+bool external_set<Key, Compare>::erase(uint64_t id, const Key &key) {
+    auto page = pool_.pin(id);
+    auto node = header(page.data());
+    if(node.leaf){
+        auto index = lower_index(page.data(), key);
+        if(index == node.count || cmp_(key, this->key(page.data(), true, index))){
+            return false;
+        }
+        auto data = page.write();
+        move_keys(data, index, data, index + 1, true, node.count - index - 1);
+        set_header(data, {1, node.count - 1, node.next});
+        return true;
+    }
+    auto index = upper_index(page.data(), key);
+    if(!erase(child(page.data(), index), key)){
+        return false;
+    }
+    fix_child(page, index);
+    return true;
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::fix_child(buffer_pool::page &parent, size_t index) {
+    //  Refills a child that fell below half full from a sibling, or merges
+    //  the two when the sibling has nothing to spare.
+    auto parent_data = parent.write();
+    auto parent_node = header(parent_data);
+    auto page = pool_.pin(child(parent_data, index));
+    auto node = header(page.data());
+    bool leaf = node.leaf;
+    if(node.count >= min_count(leaf)){
+        return;
+    }
+    auto left_index = index > 0 ? index - 1 : index;
+    auto left = index > 0 ? pool_.pin(child(parent_data, left_index)) : std::move(page);
+    auto right = index > 0 ? std::move(page) : pool_.pin(child(parent_data, index + 1));
+    auto left_data = left.write();
+    auto right_data = right.write();
+    auto left_node = header(left_data);
+    auto right_node = header(right_data);
+    auto lender = index > 0 ? left_node.count : right_node.count;
+
+    if(lender > min_count(leaf)){
+        if(index > 0){
+            //  last key of the left sibling moves to the front of the child
+            move_keys(right_data, 1, right_data, 0, leaf, right_node.count);
+            if(leaf){
+                set_key(right_data, true, 0, key(left_data, true, left_node.count - 1));
+                set_key(parent_data, false, left_index, key(right_data, true, 0));
+            } else {
+                move_children(right_data, 1, right_data, 0, right_node.count + 1);
+                set_key(right_data, false, 0, key(parent_data, false, left_index));
+                set_child(right_data, 0, child(left_data, left_node.count));
+                set_key(parent_data, false, left_index, key(left_data, false, left_node.count - 1));
+            }
+            ++right_node.count;
+            --left_node.count;
+        } else {
+            //  first key of the right sibling moves to the end of the child
+            if(leaf){
+                set_key(left_data, true, left_node.count, key(right_data, true, 0));
+                move_keys(right_data, 0, right_data, 1, true, right_node.count - 1);
+                set_key(parent_data, false, left_index, key(right_data, true, 0));
+            } else {
+                set_key(left_data, false, left_node.count, key(parent_data, false, left_index));
+                set_child(left_data, left_node.count + 1, child(right_data, 0));
+                set_key(parent_data, false, left_index, key(right_data, false, 0));
+                move_keys(right_data, 0, right_data, 1, false, right_node.count - 1);
+                move_children(right_data, 0, right_data, 1, right_node.count);
+            }
+            ++left_node.count;
+            --right_node.count;
+        }
+        set_header(left_data, left_node);
+        set_header(right_data, right_node);
+        return;
+    }
+
+    //  merge the right node into the left one
+    if(leaf){
+        move_keys(left_data, left_node.count, right_data, 0, true, right_node.count);
+        left_node.next = right_node.next;
+        left_node.count += right_node.count;
+    } else {
+        set_key(left_data, false, left_node.count, key(parent_data, false, left_index));
+        move_keys(left_data, left_node.count + 1, right_data, 0, false, right_node.count);
+        move_children(left_data, left_node.count + 1, right_data, 0, right_node.count + 1);
+        left_node.count += right_node.count + 1;
+    }
+    set_header(left_data, left_node);
+    release(std::move(right));
+    move_keys(parent_data, left_index, parent_data, left_index + 1, false, parent_node.count - left_index - 1);
+    move_children(parent_data, left_index + 1, parent_data, left_index + 2, parent_node.count - left_index - 1);
+    --parent_node.count;
+    set_header(parent_data, parent_node);
+}
+
+
+//  ----------------------------------------
+//  |      ITERATOR METHODS DEFINITIONS    |
+//  ----------------------------------------
+
+
+template<class Key, class Compare>
+external_set<Key, Compare>::iterator::iterator(const external_set *set, uint64_t leaf, size_t slot):
+    set_(set), leaf_(leaf), slot_(slot)
+{
+    settle();
+}
+
+template<class Key, class Compare>
+const Key &external_set<Key, Compare>::iterator::operator*() const {
+    return key_;
+}
+
+template<class Key, class Compare>
+const Key *external_set<Key, Compare>::iterator::operator->() const {
+    return &key_;
+}
+
+template<class Key, class Compare>
+typename external_set<Key, Compare>::iterator &external_set<Key, Compare>::iterator::operator++() {
+    ++slot_;
+    settle();
+    return *this;
+}
+
+template<class Key, class Compare>
+typename external_set<Key, Compare>::iterator external_set<Key, Compare>::iterator::operator++(int) {
+    auto copy = *this;
+    ++*this;
+    return copy;
+}
+
+template<class Key, class Compare>
+bool external_set<Key, Compare>::iterator::operator==(const iterator &rhs) const {
+    return leaf_ == rhs.leaf_ && slot_ == rhs.slot_;
+}
+
+template<class Key, class Compare>
+bool external_set<Key, Compare>::iterator::operator!=(const iterator &rhs) const {
+    return !(*this == rhs);
+}
+
+template<class Key, class Compare>
+void external_set<Key, Compare>::iterator::settle() {
+    //  Moves past the end of the current leaf into the next non-empty one and
+    //  loads the key, or becomes end() after the last leaf.
+    while(leaf_){
+        auto page = set_->pool_.pin(leaf_);
+        auto node = header(page.data());
+        if(slot_ < node.count){
+            key_ = set_->key(page.data(), true, slot_);
+            return;
+        }
+        leaf_ = node.next;
+        slot_ = 0;
+    }
+    slot_ = 0;
+}
+
+#endif //STL_COMPATIBLE_SET_EXTERNAL_SET_HPP
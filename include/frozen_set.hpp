@@ -0,0 +1,480 @@
+#ifndef STL_COMPATIBLE_SET_FROZEN_SET_HPP
+#define STL_COMPATIBLE_SET_FROZEN_SET_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "memory_usage.hpp"
+
+
+//  Read-only compressed sets, built once from a sorted sequence of unique
+//  keys such as the iteration of a set. Keys are stored in blocks of
+//  block_size: lookups binary search the first keys of the blocks and then
+//  decode at most one block sequentially, iteration decodes as it goes.
+//  Iterators are forward iterators yielding decoded copies of the keys.
+
+
+//  Strings in std::string order, front coded: every key after the first of
+//  its block is stored as the length of the prefix it shares with the
+//  previous key plus the remaining suffix. Long common prefixes such as URLs
+//  and paths shrink to a few bytes per key.
+class frozen_string_set {
+public:
+    static constexpr size_t block_size = 16;
+
+    class iterator {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = const std::string;
+        using pointer = const std::string*;
+        using reference = const std::string&;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator() = default;
+
+        reference operator*() const;
+        pointer operator->() const;
+        iterator& operator++();
+        iterator operator++(int);
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        iterator(const frozen_string_set* set, size_t index);
+        const frozen_string_set* set_ = nullptr;
+        size_t index_ = 0;
+        //  byte offset of the next entry
+        size_t offset_ = 0;
+        std::string current_;
+
+        void decode();
+
+        friend class frozen_string_set;
+    };
+
+    frozen_string_set() = default;
+    template <class InputIt>
+    frozen_string_set(InputIt first, InputIt last);
+
+    iterator begin() const;
+    iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    iterator find(std::string_view key) const;
+    iterator lower_bound(std::string_view key) const;
+    bool contains(std::string_view key) const;
+    memory_footprint memory_usage() const;
+
+private:
+    std::string bytes_;
+    //  offset of the first entry of every block
+    std::vector<size_t> blocks_;
+    size_t size_ = 0;
+
+    std::string_view first_key(size_t block) const;
+    static void put_varint(std::string& out, size_t value);
+    static size_t get_varint(const std::string& in, size_t& offset);
+};
+
+
+//  Integers bit-packed by block: the first key of each block is kept in an
+//  index, every other key as its distance to the previous one minus one, in
+//  as many bits as the largest distance of the block needs. Dense sets take
+//  a few bits per key.
+template <class T>
+class frozen_int_set {
+    static_assert(std::is_integral<T>::value, "frozen_int_set stores integers");
+    using Unsigned = std::make_unsigned_t<T>;
+
+public:
+    static constexpr size_t block_size = 128;
+
+    class iterator {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = const T;
+        using pointer = const T*;
+        using reference = const T&;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator() = default;
+
+        reference operator*() const;
+        pointer operator->() const;
+        iterator& operator++();
+        iterator operator++(int);
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        iterator(const frozen_int_set* set, size_t index);
+        const frozen_int_set* set_ = nullptr;
+        size_t index_ = 0;
+        size_t bit_ = 0;
+        unsigned width_ = 0;
+        T current_ = T();
+
+        friend class frozen_int_set;
+    };
+
+    frozen_int_set() = default;
+    template <class InputIt>
+    frozen_int_set(InputIt first, InputIt last);
+
+    iterator begin() const;
+    iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    iterator find(T key) const;
+    iterator lower_bound(T key) const;
+    bool contains(T key) const;
+    memory_footprint memory_usage() const;
+
+private:
+    std::vector<T> firsts_;
+    std::vector<size_t> offsets_;
+    std::vector<unsigned char> widths_;
+    std::vector<uint64_t> words_;
+    size_t size_ = 0;
+
+    void put_bits(size_t& bit, uint64_t value, unsigned width);
+    uint64_t get_bits(size_t bit, unsigned width) const;
+};
+
+
+//  --------------------------------------------
+//  |    FROZEN STRING SET DEFINITIONS         |
+//  --------------------------------------------
+
+
+template<class InputIt>
+frozen_string_set::frozen_string_set(InputIt first, InputIt last) {
+    std::string previous;
+    for(; first != last; ++first){
+        const std::string& key = *first;
+        if(size_ % block_size == 0){
+            blocks_.push_back(bytes_.size());
+            put_varint(bytes_, key.size());
+            bytes_ += key;
+        } else {
+            auto shared = std::mismatch(previous.begin(), previous.end(), key.begin(), key.end()).first - previous.begin();
+            put_varint(bytes_, shared);
+            put_varint(bytes_, key.size() - shared);
+            bytes_.append(key, shared, std::string::npos);
+        }
+        previous = key;
+        ++size_;
+    }
+    bytes_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+}
+
+inline frozen_string_set::iterator frozen_string_set::begin() const {
+    return iterator(this, 0);
+}
+
+inline frozen_string_set::iterator frozen_string_set::end() const {
+    return iterator(this, size_);
+}
+
+inline size_t frozen_string_set::size() const {
+    return size_;
+}
+
+inline bool frozen_string_set::empty() const {
+    return size_ == 0;
+}
+
+inline frozen_string_set::iterator frozen_string_set::find(std::string_view key) const {
+    auto it = lower_bound(key);
+    return it != end() && *it == key ? it : end();
+}
+
+inline frozen_string_set::iterator frozen_string_set::lower_bound(std::string_view key) const {
+    //  last block starting at or before key, then a scan inside it
+    size_t first = 0;
+    size_t last = blocks_.size();
+    while(first < last){
+        auto middle = (first + last) / 2;
+        if(first_key(middle) <= key){
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    if(first == 0){
+        return begin();
+    }
+    iterator it(this, (first - 1) * block_size);
+    while(it != end() && std::string_view(*it) < key){
+        ++it;
+    }
+    return it;
+}
+
+inline bool frozen_string_set::contains(std::string_view key) const {
+    return find(key) != end();
+}
+
+inline memory_footprint frozen_string_set::memory_usage() const {
+    memory_footprint usage;
+    usage.key_bytes = bytes_.capacity();
+    usage.overhead_bytes = blocks_.capacity() * sizeof(size_t);
+    usage.object_bytes = sizeof(*this);
+    return usage;
+}
+
+inline std::string_view frozen_string_set::first_key(size_t block) const {
+    auto offset = blocks_[block];
+    auto length = get_varint(bytes_, offset);
+    return std::string_view(bytes_.data() + offset, length);
+}
+
+inline void frozen_string_set::put_varint(std::string &out, size_t value) {
+    for(; value >= 0x80; value >>= 7){
+        out.push_back(char(value | 0x80));
+    }
+    out.push_back(char(value));
+}
+
+inline size_t frozen_string_set::get_varint(const std::string &in, size_t &offset) {
+    size_t value = 0;
+    for(unsigned shift = 0;; shift += 7){
+        auto byte = static_cast<unsigned char>(in[offset++]);
+        value |= size_t(byte & 0x7f) << shift;
+        if(byte < 0x80){
+            return value;
+        }
+    }
+}
+
+
+inline frozen_string_set::iterator::iterator(const frozen_string_set *set, size_t index):
+    set_(set), index_(index)
+{
+    if(index_ < set_->size_){
+        offset_ = set_->blocks_[index_ / block_size];
+        decode();
+    }
+}
+
+inline frozen_string_set::iterator::reference frozen_string_set::iterator::operator*() const {
+    return current_;
+}
+
+inline frozen_string_set::iterator::pointer frozen_string_set::iterator::operator->() const {
+    return &current_;
+}
+
+inline frozen_string_set::iterator &frozen_string_set::iterator::operator++() {
+    if(++index_ < set_->size_){
+        decode();
+    }
+    return *this;
+}
+
+inline frozen_string_set::iterator frozen_string_set::iterator::operator++(int) {
+    auto copy = *this;
+    ++*this;
+    return copy;
+}
+
+inline bool frozen_string_set::iterator::operator==(const iterator &rhs) const {
+    return index_ == rhs.index_;
+}
+
+inline bool frozen_string_set::iterator::operator!=(const iterator &rhs) const {
+    return !(*this == rhs);
+}
+
+inline void frozen_string_set::iterator::decode() {
+    auto& bytes = set_->bytes_;
+    size_t shared = 0;
+    if(index_ % block_size != 0){
+        shared = get_varint(bytes, offset_);
+    }
+    auto suffix = get_varint(bytes, offset_);
+    current_.resize(shared);
+    current_.append(bytes, offset_, suffix);
+    offset_ += suffix;
+}
+
+
+//  --------------------------------------------
+//  |      FROZEN INT SET DEFINITIONS          |
+//  --------------------------------------------
+
+
+template<class T>
+template<class InputIt>
+frozen_int_set<T>::frozen_int_set(InputIt first, InputIt last) {
+    std::vector<T> keys(first, last);
+    size_ = keys.size();
+    size_t bit = 0;
+    for(size_t start = 0; start < keys.size(); start += block_size){
+        auto stop = std::min(keys.size(), start + block_size);
+        Unsigned widest = 0;
+        for(auto i = start + 1; i < stop; ++i){
+            //  narrow types promote to int, cast back so the gap wraps in T's width
+            widest = std::max(widest, Unsigned(Unsigned(keys[i]) - Unsigned(keys[i - 1]) - 1));
+        }
+        unsigned width = 0;
+        for(; width < 64 && (uint64_t(widest) >> width) != 0; ++width){}
+        firsts_.push_back(keys[start]);
+        offsets_.push_back(bit);
+        widths_.push_back(width);
+        for(auto i = start + 1; i < stop; ++i){
+            put_bits(bit, Unsigned(Unsigned(keys[i]) - Unsigned(keys[i - 1]) - 1), width);
+        }
+    }
+    words_.shrink_to_fit();
+}
+
+template<class T>
+typename frozen_int_set<T>::iterator frozen_int_set<T>::begin() const {
+    return iterator(this, 0);
+}
+
+template<class T>
+typename frozen_int_set<T>::iterator frozen_int_set<T>::end() const {
+    return iterator(this, size_);
+}
+
+template<class T>
+size_t frozen_int_set<T>::size() const {
+    return size_;
+}
+
+template<class T>
+bool frozen_int_set<T>::empty() const {
+    return size_ == 0;
+}
+
+template<class T>
+typename frozen_int_set<T>::iterator frozen_int_set<T>::find(T key) const {
+    auto it = lower_bound(key);
+    return it != end() && *it == key ? it : end();
+}
+
+template<class T>
+typename frozen_int_set<T>::iterator frozen_int_set<T>::lower_bound(T key) const {
+    auto block = std::upper_bound(firsts_.begin(), firsts_.end(), key) - firsts_.begin();
+    if(block == 0){
+        return begin();
+    }
+    iterator it(this, (block - 1) * block_size);
+    while(it != end() && *it < key){
+        ++it;
+    }
+    return it;
+}
+
+template<class T>
+bool frozen_int_set<T>::contains(T key) const {
+    return find(key) != end();
+}
+
+template<class T>
+memory_footprint frozen_int_set<T>::memory_usage() const {
+    memory_footprint usage;
+    usage.key_bytes = words_.capacity() * sizeof(uint64_t);
+    usage.overhead_bytes = firsts_.capacity() * sizeof(T) + offsets_.capacity() * sizeof(size_t) + widths_.capacity();
+    usage.object_bytes = sizeof(*this);
+    return usage;
+}
+
+template<class T>
+void frozen_int_set<T>::put_bits(size_t &bit, uint64_t value, unsigned width) {
+    if(width == 0){
+        return;
+    }
+    if(width < 64){
+        value &= (uint64_t(1) << width) - 1;
+    }
+    auto shift = bit % 64;
+    if(bit / 64 >= words_.size()){
+        words_.push_back(0);
+    }
+    words_[bit / 64] |= value << shift;
+    if(shift + width > 64){
+        words_.push_back(value >> (64 - shift));
+    }
+    bit += width;
+}
+
+template<class T>
+uint64_t frozen_int_set<T>::get_bits(size_t bit, unsigned width) const {
+    if(width == 0){
+        return 0;
+    }
+    auto shift = bit % 64;
+    auto value = words_[bit / 64] >> shift;
+    if(shift + width > 64){
+        value |= words_[bit / 64 + 1] << (64 - shift);
+    }
+    return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+}
+
+
+template<class T>
+frozen_int_set<T>::iterator::iterator(const frozen_int_set *set, size_t index):
+    set_(set), index_(index)
+{
+    if(index_ < set_->size_){
+        auto block = index_ / block_size;
+        current_ = set_->firsts_[block];
+        bit_ = set_->offsets_[block];
+        width_ = set_->widths_[block];
+    }
+}
+
+template<class T>
+const T &frozen_int_set<T>::iterator::operator*() const {
+    return current_;
+}
+
+template<class T>
+const T *frozen_int_set<T>::iterator::operator->() const {
+    return &current_;
+}
+
+template<class T>
+typename frozen_int_set<T>::iterator &frozen_int_set<T>::iterator::operator++() {
+    if(++index_ >= set_->size_){
+        return *this;
+    }
+    if(index_ % block_size == 0){
+        *this = iterator(set_, index_);
+        return *this;
+    }
+    current_ = T(Unsigned(current_) + Unsigned(set_->get_bits(bit_, width_)) + 1);
+    bit_ += width_;
+    return *this;
+}
+
+template<class T>
+typename frozen_int_set<T>::iterator frozen_int_set<T>::iterator::operator++(int) {
+    auto copy = *this;
+    ++*this;
+    return copy;
+}
+
+template<class T>
+bool frozen_int_set<T>::iterator::operator==(const iterator &rhs) const {
+    return index_ == rhs.index_;
+}
+
+template<class T>
+bool frozen_int_set<T>::iterator::operator!=(const iterator &rhs) const {
+    return !(*this == rhs);
+}
+
+#endif //STL_COMPATIBLE_SET_FROZEN_SET_HPP
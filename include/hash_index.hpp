@@ -0,0 +1,175 @@
+#ifndef STL_COMPATIBLE_SET_HASH_INDEX_HPP
+#define STL_COMPATIBLE_SET_HASH_INDEX_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+
+//  Open-addressing hash table from key to tree node with linear probing and
+//  backward-shift deletion, so there are no tombstones. It only stores node
+//  pointers: keys are read through them and the owning tree keeps them alive.
+//  The hash is a plain function pointer so that the index can be switched on
+//  at run time without making the key type hashable for every set.
+template <typename Key, typename Node, typename Compare = std::less<Key>>
+class HashIndex{
+public:
+    using hash_function = size_t (*)(const Key&);
+
+    HashIndex() = default;
+    HashIndex(hash_function function, const Compare& cmp);
+
+    bool enabled() const;
+    hash_function hash() const;
+    size_t size() const;
+
+    void insert(const Node* node);
+    void erase(const Key& key);
+    const Node* find(const Key& key) const;
+    void clear();
+    //  Empties the table but keeps its slots for the next fill.
+    void reset();
+    void reserve(size_t count);
+
+    size_t memory_usage() const;
+
+private:
+    std::vector<const Node*> slots_;
+    size_t size_ = 0;
+    hash_function hash_ = nullptr;
+    Compare cmp_;
+
+    size_t home(const Key& key) const;
+    size_t probe(const Key& key) const;
+    void grow(size_t capacity);
+};
+
+
+//  ----------------------------------------
+//  |       HASH INDEX DEFINITIONS         |
+//  ----------------------------------------
+
+
+template<typename Key, typename Node, typename Compare>
+HashIndex<Key, Node, Compare>::HashIndex(hash_function function, const Compare &cmp):
+    hash_(function), cmp_(cmp)
+{}
+
+template<typename Key, typename Node, typename Compare>
+bool HashIndex<Key, Node, Compare>::enabled() const {
+    return hash_ != nullptr;
+}
+
+template<typename Key, typename Node, typename Compare>
+typename HashIndex<Key, Node, Compare>::hash_function HashIndex<Key, Node, Compare>::hash() const {
+    return hash_;
+}
+
+template<typename Key, typename Node, typename Compare>
+size_t HashIndex<Key, Node, Compare>::size() const {
+    return size_;
+}
+
+template<typename Key, typename Node, typename Compare>
+void HashIndex<Key, Node, Compare>::insert(const Node *node) {
+    if((size_ + 1) * 10 > slots_.size() * 7){
+        grow(slots_.empty() ? 16 : slots_.size() * 2);
+    }
+    auto slot = probe(node->key);
+    if(!slots_[slot]){
+        ++size_;
+    }
+    slots_[slot] = node;
+}
+
+template<typename Key, typename Node, typename Compare>
+void HashIndex<Key, Node, Compare>::erase(const Key &key) {
+    if(slots_.empty()){
+        return;
+    }
+    auto hole = probe(key);
+    if(!slots_[hole]){
+        return;
+    }
+    slots_[hole] = nullptr;
+    --size_;
+
+    auto mask = slots_.size() - 1;
+    for(auto next = (hole + 1) & mask; slots_[next]; next = (next + 1) & mask){
+        auto desired = home(slots_[next]->key);
+        //  the entry may fill the hole unless its home lies in (hole, next]
+        if(((next - desired) & mask) >= ((next - hole) & mask)){
+            slots_[hole] = slots_[next];
+            slots_[next] = nullptr;
+            hole = next;
+        }
+    }
+}
+
+template<typename Key, typename Node, typename Compare>
+const Node *HashIndex<Key, Node, Compare>::find(const Key &key) const {
+    if(slots_.empty()){
+        return nullptr;
+    }
+    return slots_[probe(key)];
+}
+
+template<typename Key, typename Node, typename Compare>
+void HashIndex<Key, Node, Compare>::clear() {
+    slots_.clear();
+    slots_.shrink_to_fit();
+    size_ = 0;
+}
+
+template<typename Key, typename Node, typename Compare>
+void HashIndex<Key, Node, Compare>::reset() {
+    std::fill(slots_.begin(), slots_.end(), nullptr);
+    size_ = 0;
+}
+
+template<typename Key, typename Node, typename Compare>
+void HashIndex<Key, Node, Compare>::reserve(size_t count) {
+    size_t capacity = 16;
+    while(count * 10 > capacity * 7){
+        capacity *= 2;
+    }
+    if(capacity > slots_.size()){
+        grow(capacity);
+    }
+}
+
+template<typename Key, typename Node, typename Compare>
+size_t HashIndex<Key, Node, Compare>::memory_usage() const {
+    return slots_.capacity() * sizeof(const Node*);
+}
+
+template<typename Key, typename Node, typename Compare>
+size_t HashIndex<Key, Node, Compare>::home(const Key &key) const {
+    //  spread the bits first: std::hash is the identity for integers
+    auto hash = static_cast<unsigned long long>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(hash ^ (hash >> 32)) & (slots_.size() - 1);
+}
+
+template<typename Key, typename Node, typename Compare>
+size_t HashIndex<Key, Node, Compare>::probe(const Key &key) const {
+    auto mask = slots_.size() - 1;
+    auto slot = home(key);
+    while(slots_[slot] && (cmp_(key, slots_[slot]->key) || cmp_(slots_[slot]->key, key))){
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+template<typename Key, typename Node, typename Compare>
+void HashIndex<Key, Node, Compare>::grow(size_t capacity) {
+    std::vector<const Node*> old(capacity, nullptr);
+    old.swap(slots_);
+    for(auto node: old){
+        if(node){
+            slots_[probe(node->key)] = node;
+        }
+    }
+}
+
+#endif //STL_COMPATIBLE_SET_HASH_INDEX_HPP
@@ -0,0 +1,282 @@
+#ifndef STL_COMPATIBLE_SET_INLINE_ARRAY_HPP
+#define STL_COMPATIBLE_SET_INLINE_ARRAY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <utility>
+
+
+//  Sorted array of at most N unique keys stored inside the object itself. Used
+//  by set while it is small, so that small sets never touch the heap.
+template <typename Key, typename Compare = std::less<Key>, size_t N = 16>
+class InlineArray{
+public:
+    InlineArray();
+    explicit InlineArray(const Compare& cmp);
+    InlineArray(const InlineArray& other);
+    InlineArray(InlineArray&& other) noexcept;
+    ~InlineArray();
+
+    InlineArray& operator=(const InlineArray& other);
+    InlineArray& operator=(InlineArray&& other) noexcept;
+
+    static constexpr size_t capacity = N;
+
+    const Key* data() const;
+    const Key* search(const Key& key) const;
+    const Key* lower_bound(const Key& key) const;
+    const Key* upper_bound(const Key& key) const;
+
+    //  Returns false if the key is already present. Must not be called on a
+    //  full array with a new key.
+    bool insert(const Key& key);
+    bool erase(const Key& key);
+    //  Erases the keys in [first, last), both pointing into this array.
+    size_t erase(const Key* first, const Key* last);
+    template <class Predicate>
+    size_t erase_if(Predicate pred);
+    //  Appends a key greater than every stored one.
+    void push_back(const Key& key);
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+    bool full() const;
+
+    const Compare& key_comp() const;
+
+private:
+    alignas(Key) unsigned char storage_[sizeof(Key) * (N ? N : 1)];
+    size_t size_;
+    Compare cmp_;
+
+    Key* slots();
+    //  Moves the key in slot from into the empty slot to. Keys are only ever
+    //  constructed and destroyed in place, never assigned.
+    void relocate(size_t from, size_t to);
+};
+
+
+//  ------------------------------------------
+//  |       INLINE ARRAY DEFINITIONS         |
+//  ------------------------------------------
+
+
+template<typename Key, typename Compare, size_t N>
+InlineArray<Key, Compare, N>::InlineArray():
+    size_(0), cmp_(Compare())
+{}
+
+template<typename Key, typename Compare, size_t N>
+InlineArray<Key, Compare, N>::InlineArray(const Compare &cmp):
+    size_(0), cmp_(cmp)
+{}
+
+template<typename Key, typename Compare, size_t N>
+InlineArray<Key, Compare, N>::InlineArray(const InlineArray &other):
+    size_(0), cmp_(other.cmp_)
+{
+    for(size_t i = 0; i < other.size_; ++i){
+        push_back(other.data()[i]);
+    }
+}
+
+template<typename Key, typename Compare, size_t N>
+InlineArray<Key, Compare, N>::InlineArray(InlineArray &&other) noexcept:
+    size_(0), cmp_(std::move(other.cmp_))
+{
+    for(size_t i = 0; i < other.size_; ++i){
+        new (slots() + i) Key(std::move(other.data()[i]));
+    }
+    size_ = other.size_;
+    other.clear();
+}
+
+template<typename Key, typename Compare, size_t N>
+InlineArray<Key, Compare, N>::~InlineArray() {
+    clear();
+}
+
+template<typename Key, typename Compare, size_t N>
+InlineArray<Key, Compare, N> &InlineArray<Key, Compare, N>::operator=(const InlineArray &other) {
+    if(this == &other){
+        return *this;
+    }
+    clear();
+    cmp_ = other.cmp_;
+    for(size_t i = 0; i < other.size_; ++i){
+        push_back(other.data()[i]);
+    }
+    return *this;
+}
+
+template<typename Key, typename Compare, size_t N>
+InlineArray<Key, Compare, N> &InlineArray<Key, Compare, N>::operator=(InlineArray &&other) noexcept {
+    if(this == &other){
+        return *this;
+    }
+    clear();
+    cmp_ = std::move(other.cmp_);
+    for(size_t i = 0; i < other.size_; ++i){
+        new (slots() + i) Key(std::move(other.data()[i]));
+    }
+    size_ = other.size_;
+    other.clear();
+    return *this;
+}
+
+template<typename Key, typename Compare, size_t N>
+const Key *InlineArray<Key, Compare, N>::data() const {
+    return std::launder(reinterpret_cast<const Key*>(storage_));
+}
+
+template<typename Key, typename Compare, size_t N>
+Key *InlineArray<Key, Compare, N>::slots() {
+    return std::launder(reinterpret_cast<Key*>(storage_));
+}
+
+template<typename Key, typename Compare, size_t N>
+void InlineArray<Key, Compare, N>::relocate(size_t from, size_t to) {
+    new (slots() + to) Key(std::move(slots()[from]));
+    slots()[from].~Key();
+}
+
+template<typename Key, typename Compare, size_t N>
+const Key *InlineArray<Key, Compare, N>::search(const Key &key) const {
+    auto it = lower_bound(key);
+    if(it != data() + size_ && !cmp_(key, *it)){
+        return it;
+    }
+    return nullptr;
+}
+
+template<typename Key, typename Compare, size_t N>
+const Key *InlineArray<Key, Compare, N>::lower_bound(const Key &key) const {
+    return std::lower_bound(data(), data() + size_, key, cmp_);
+}
+
+template<typename Key, typename Compare, size_t N>
+const Key *InlineArray<Key, Compare, N>::upper_bound(const Key &key) const {
+    return std::upper_bound(data(), data() + size_, key, cmp_);
+}
+
+template<typename Key, typename Compare, size_t N>
+bool InlineArray<Key, Compare, N>::insert(const Key &key) {
+    size_t pos = lower_bound(key) - slots();
+    if(pos < size_ && !cmp_(key, slots()[pos])){
+        return false;
+    }
+    if(pos == size_){
+        new (slots() + size_) Key(key);
+    } else {
+        //  copy first, so that a throwing copy leaves the array untouched
+        Key copy(key);
+        for(size_t i = size_; i > pos; --i){
+            relocate(i - 1, i);
+        }
+        new (slots() + pos) Key(std::move(copy));
+    }
+    ++size_;
+    return true;
+}
+
+template<typename Key, typename Compare, size_t N>
+bool InlineArray<Key, Compare, N>::erase(const Key &key) {
+    auto found = search(key);
+    if(!found){
+        return false;
+    }
+    size_t pos = found - slots();
+    slots()[pos].~Key();
+    for(size_t i = pos + 1; i < size_; ++i){
+        relocate(i, i - 1);
+    }
+    --size_;
+    return true;
+}
+
+template<typename Key, typename Compare, size_t N>
+size_t InlineArray<Key, Compare, N>::erase(const Key *first, const Key *last) {
+    size_t pos = first - slots();
+    size_t count = last - first;
+    if(!count){
+        return 0;
+    }
+    for(size_t i = pos; i < pos + count; ++i){
+        slots()[i].~Key();
+    }
+    for(size_t i = pos + count; i < size_; ++i){
+        relocate(i, i - count);
+    }
+    size_ -= count;
+    return count;
+}
+
+template<typename Key, typename Compare, size_t N>
+template<class Predicate>
+size_t InlineArray<Key, Compare, N>::erase_if(Predicate pred) {
+    size_t kept = 0;
+    size_t i = 0;
+    try {
+        for(; i < size_; ++i){
+            if(pred(static_cast<const Key&>(slots()[i]))){
+                slots()[i].~Key();
+                continue;
+            }
+            if(kept != i){
+                relocate(i, kept);
+            }
+            ++kept;
+        }
+    } catch(...) {
+        //  close the gap left by the keys erased so far
+        for(; i < size_; ++i, ++kept){
+            if(kept != i){
+                relocate(i, kept);
+            }
+        }
+        size_ = kept;
+        throw;
+    }
+    auto count = size_ - kept;
+    size_ = kept;
+    return count;
+}
+
+template<typename Key, typename Compare, size_t N>
+void InlineArray<Key, Compare, N>::push_back(const Key &key) {
+    new (slots() + size_) Key(key);
+    ++size_;
+}
+
+template<typename Key, typename Compare, size_t N>
+void InlineArray<Key, Compare, N>::clear() {
+    for(size_t i = 0; i < size_; ++i){
+        slots()[i].~Key();
+    }
+    size_ = 0;
+}
+
+template<typename Key, typename Compare, size_t N>
+size_t InlineArray<Key, Compare, N>::size() const {
+    return size_;
+}
+
+template<typename Key, typename Compare, size_t N>
+bool InlineArray<Key, Compare, N>::empty() const {
+    return size_ == 0;
+}
+
+template<typename Key, typename Compare, size_t N>
+bool InlineArray<Key, Compare, N>::full() const {
+    return size_ == N;
+}
+
+template<typename Key, typename Compare, size_t N>
+const Compare &InlineArray<Key, Compare, N>::key_comp() const {
+    return cmp_;
+}
+
+#endif //STL_COMPATIBLE_SET_INLINE_ARRAY_HPP
@@ -0,0 +1,69 @@
+#ifndef STL_COMPATIBLE_SET_KEY_CODEC_HPP
+#define STL_COMPATIBLE_SET_KEY_CODEC_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+
+//  Customisation point for writing keys to files: encode appends the bytes of
+//  a key to out, decode reads one key starting at first, advances first past
+//  it and returns false if [first, last) ends too early. Trivially copyable
+//  keys are stored as they are in memory, strings with a length prefix;
+//  specialise it for any other key type.
+template <class Key>
+struct key_codec {
+    static_assert(std::is_trivially_copyable<Key>::value, "specialise key_codec for this key type");
+
+    static void encode(const Key& key, std::string& out) {
+        out.append(reinterpret_cast<const char*>(&key), sizeof(Key));
+    }
+
+    static bool decode(const char*& first, const char* last, Key& key) {
+        if(size_t(last - first) < sizeof(Key)){
+            return false;
+        }
+        std::memcpy(&key, first, sizeof(Key));
+        first += sizeof(Key);
+        return true;
+    }
+};
+
+template <class CharT, class Traits, class Alloc>
+struct key_codec<std::basic_string<CharT, Traits, Alloc>> {
+    using Key = std::basic_string<CharT, Traits, Alloc>;
+
+    static void encode(const Key& key, std::string& out) {
+        uint32_t length = key.size();
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.append(reinterpret_cast<const char*>(key.data()), length * sizeof(CharT));
+    }
+
+    static bool decode(const char*& first, const char* last, Key& key) {
+        uint32_t length;
+        if(size_t(last - first) < sizeof(length)){
+            return false;
+        }
+        std::memcpy(&length, first, sizeof(length));
+        if(size_t(last - first) - sizeof(length) < length * sizeof(CharT)){
+            return false;
+        }
+        key.resize(length);
+        std::memcpy(&key[0], first + sizeof(length), length * sizeof(CharT));
+        first += sizeof(length) + length * sizeof(CharT);
+        return true;
+    }
+};
+
+
+//  FNV-1a over a byte range, used to detect torn or damaged records.
+inline uint32_t checksum(const char* first, const char* last) {
+    uint32_t hash = 2166136261u;
+    for(; first != last; ++first){
+        hash = (hash ^ static_cast<unsigned char>(*first)) * 16777619u;
+    }
+    return hash;
+}
+
+#endif //STL_COMPATIBLE_SET_KEY_CODEC_HPP
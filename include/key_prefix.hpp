@@ -0,0 +1,78 @@
+#ifndef STL_COMPATIBLE_SET_KEY_PREFIX_HPP
+#define STL_COMPATIBLE_SET_KEY_PREFIX_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+
+//  Inline key prefixes for Tree nodes. With a prefix policy enabled every node
+//  caches the first eight bytes of its key as a big-endian integer plus the
+//  key length, and searches compute the same for the probe once. Two keys
+//  whose prefixes differ, or that are both at most eight bytes long, are then
+//  ordered by integer compares without touching the string buffers; only
+//  ties on a longer prefix fall back to Compare.
+//
+//  A policy has to agree with Compare: ordering the zero-padded prefixes as
+//  unsigned integers must never contradict it, which holds for byte strings
+//  compared lexicographically as unsigned chars, like std::string under
+//  std::less. Specialise key_prefix as string_key_prefix for other such key
+//  and comparator pairs.
+
+
+template <class Key, class Compare>
+struct key_prefix {
+    static constexpr bool enabled = false;
+};
+
+
+//  Prefix policy for keys with data() and size() over single bytes.
+struct string_key_prefix {
+    static constexpr bool enabled = true;
+
+    template <class Key>
+    static uint64_t make(const Key& key) {
+        uint64_t prefix = 0;
+        auto length = key.size() < 8 ? key.size() : 8;
+        for(size_t i = 0; i < length; ++i){
+            prefix |= uint64_t(static_cast<unsigned char>(key.data()[i])) << (56 - 8 * i);
+        }
+        return prefix;
+    }
+};
+
+template <class Alloc>
+struct key_prefix<std::basic_string<char, std::char_traits<char>, Alloc>,
+                  std::less<std::basic_string<char, std::char_traits<char>, Alloc>>>: string_key_prefix {};
+
+template <class Alloc>
+struct key_prefix<std::basic_string<char, std::char_traits<char>, Alloc>, std::less<>>: string_key_prefix {};
+
+
+//  Storage for the cached prefix inside a node; empty when the policy is off.
+//  Lengths are capped at 9, only whether a key fits the prefix matters.
+template <class Key, class Compare, bool = key_prefix<Key, Compare>::enabled>
+struct key_prefix_slot {
+    key_prefix_slot() = default;
+    explicit key_prefix_slot(const Key&) {}
+
+    void cache(const Key&) {}
+};
+
+template <class Key, class Compare>
+struct key_prefix_slot<Key, Compare, true> {
+    uint64_t prefix;
+    uint32_t length;
+
+    key_prefix_slot() = default;
+    explicit key_prefix_slot(const Key& key) {
+        cache(key);
+    }
+
+    void cache(const Key& key) {
+        prefix = key_prefix<Key, Compare>::make(key);
+        length = key.size() < 9 ? uint32_t(key.size()) : 9;
+    }
+};
+
+#endif //STL_COMPATIBLE_SET_KEY_PREFIX_HPP
@@ -0,0 +1,207 @@
+#ifndef STL_COMPATIBLE_SET_MEMORY_USAGE_HPP
+#define STL_COMPATIBLE_SET_MEMORY_USAGE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+
+//  Breakdown of the bytes held by a container. node_bytes counts the node
+//  objects themselves, overhead_bytes what the container spends beyond them
+//  (allocator headers and padding of every node allocation, unused slots of a
+//  compacted node block, side indexes),
+//  key_bytes the out-of-line storage owned by the keys and object_bytes the
+//  container object.
+struct memory_footprint {
+    size_t nodes = 0;
+    size_t node_bytes = 0;
+    size_t overhead_bytes = 0;
+    size_t key_bytes = 0;
+    size_t object_bytes = 0;
+
+    size_t total() const;
+    memory_footprint& operator+=(const memory_footprint& other);
+};
+
+
+//  Estimated bytes a general purpose allocator uses for one block of size
+//  bytes on top of the block: a size word in front and rounding up to 16
+//  bytes, with a 32 byte minimum, as glibc malloc does.
+inline size_t allocation_overhead(size_t size) {
+    auto chunk = (size + sizeof(size_t) + 15) / 16 * 16;
+    return (chunk < 32 ? 32 : chunk) - size;
+}
+
+
+//  Customisation point for keys owning heap memory: specialise it and return
+//  the number of bytes the key keeps outside of the node.
+template <class Key>
+struct key_memory {
+    static size_t out_of_line(const Key&) {
+        return 0;
+    }
+};
+
+template <class CharT, class Traits, class Alloc>
+struct key_memory<std::basic_string<CharT, Traits, Alloc>> {
+    static size_t out_of_line(const std::basic_string<CharT, Traits, Alloc>& key) {
+        auto begin = reinterpret_cast<const char*>(&key);
+        auto data = reinterpret_cast<const char*>(key.data());
+        if(data >= begin && data < begin + sizeof(key)){
+            return 0;
+        }
+        return (key.capacity() + 1) * sizeof(CharT);
+    }
+};
+
+
+//  Process-wide list of named containers. Every tracked container stays
+//  registered while the returned handle is alive, containers sharing a name are
+//  summed up in the report.
+//
+//  The registry keeps a reference to each container and calls its
+//  memory_usage() from whichever thread asks for totals or a dump, without
+//  synchronising with the container's writers. So a tracked container must
+//  not be moved or destroyed before its handle is released, and reports
+//  must not run while it is being modified.
+class memory_registry {
+public:
+    class handle {
+    public:
+        handle() = default;
+        handle(const handle&) = delete;
+        handle(handle&& other) noexcept;
+        ~handle();
+
+        handle& operator=(const handle&) = delete;
+        handle& operator=(handle&& other) noexcept;
+
+        void release();
+
+    private:
+        explicit handle(size_t id);
+        size_t id_ = 0;
+
+        friend class memory_registry;
+    };
+
+    static memory_registry& instance();
+
+    //  container must stay at its address until the handle is released.
+    template <class Container>
+    handle track(const std::string& name, const Container& container);
+
+    //  Both call memory_usage() on every tracked container, see above.
+    std::map<std::string, memory_footprint> totals() const;
+    void dump(std::ostream& os) const;
+
+private:
+    struct entry {
+        std::string name;
+        std::function<memory_footprint()> usage;
+    };
+
+    memory_registry() = default;
+    void erase(size_t id);
+
+    mutable std::mutex mutex_;
+    std::map<size_t, entry> entries_;
+    size_t next_id_ = 1;
+};
+
+
+//  --------------------------------------------
+//  |       FOOTPRINT METHODS DEFINITIONS      |
+//  --------------------------------------------
+
+
+inline size_t memory_footprint::total() const {
+    return node_bytes + overhead_bytes + key_bytes + object_bytes;
+}
+
+inline memory_footprint& memory_footprint::operator+=(const memory_footprint &other) {
+    nodes += other.nodes;
+    node_bytes += other.node_bytes;
+    overhead_bytes += other.overhead_bytes;
+    key_bytes += other.key_bytes;
+    object_bytes += other.object_bytes;
+    return *this;
+}
+
+
+//  --------------------------------------------
+//  |       REGISTRY METHODS DEFINITIONS       |
+//  --------------------------------------------
+
+
+inline memory_registry &memory_registry::instance() {
+    static memory_registry registry;
+    return registry;
+}
+
+template<class Container>
+memory_registry::handle memory_registry::track(const std::string &name, const Container &container) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto id = next_id_++;
+    entries_[id] = entry{name, [&container](){ return container.memory_usage(); }};
+    return handle(id);
+}
+
+inline std::map<std::string, memory_footprint> memory_registry::totals() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, memory_footprint> result;
+    for(const auto& item: entries_){
+        result[item.second.name] += item.second.usage();
+    }
+    return result;
+}
+
+inline void memory_registry::dump(std::ostream &os) const {
+    for(const auto& item: totals()){
+        os << item.first << ": " << item.second.total() << " bytes ("
+           << item.second.nodes << " nodes, "
+           << item.second.node_bytes << " node, "
+           << item.second.overhead_bytes << " overhead, "
+           << item.second.key_bytes << " key)\n";
+    }
+}
+
+inline void memory_registry::erase(size_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(id);
+}
+
+inline memory_registry::handle::handle(size_t id):
+    id_(id)
+{}
+
+inline memory_registry::handle::handle(handle &&other) noexcept:
+    id_(other.id_)
+{
+    other.id_ = 0;
+}
+
+inline memory_registry::handle::~handle() {
+    release();
+}
+
+inline memory_registry::handle &memory_registry::handle::operator=(handle &&other) noexcept {
+    if(this != &other){
+        release();
+        id_ = other.id_;
+        other.id_ = 0;
+    }
+    return *this;
+}
+
+inline void memory_registry::handle::release() {
+    if(id_){
+        memory_registry::instance().erase(id_);
+        id_ = 0;
+    }
+}
+
+#endif //STL_COMPATIBLE_SET_MEMORY_USAGE_HPP
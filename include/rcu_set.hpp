@@ -0,0 +1,610 @@
+#ifndef STL_COMPATIBLE_SET_RCU_SET_HPP
+#define STL_COMPATIBLE_SET_RCU_SET_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+//  Ordered set for one writer and many readers. Published nodes are never
+//  modified: the writer copies the path from the root down to every node it
+//  changes, rotations included, and publishes the new root with one release
+//  store. Readers therefore walk a consistent version of the tree without
+//  locks and without atomic read-modify-write operations, and their latency
+//  does not depend on the write rate.
+//
+//  Replaced nodes are retired and freed once no reader can still see them:
+//  every reader announces the global epoch it started in, the writer bumps
+//  the epoch after each update and frees nodes retired before the oldest
+//  announced epoch.
+//
+//  The tree is balanced as an AVL tree. insert, erase and clear must be
+//  called from one thread at a time; readers must not outlive the set.
+template <class Key, class Compare = std::less<Key>>
+class rcu_set {
+    struct Node {
+        const Node* left;
+        const Node* right;
+        Key key;
+        unsigned char height;
+        //  update that created the node: nodes of the running update are not
+        //  published yet and may be freed right away
+        uint64_t version;
+    };
+
+    struct reader_slot {
+        alignas(64) std::atomic<uint64_t> epoch{idle};
+        bool used = false;
+    };
+
+    static constexpr uint64_t idle = std::numeric_limits<uint64_t>::max();
+
+public:
+    class reader;
+
+    //  Read-side critical section: pins the version of the tree that was
+    //  current when it was taken. Keys and iterators stay valid until the
+    //  snapshot is destroyed.
+    class snapshot {
+    public:
+        class iterator {
+        public:
+            using difference_type = std::ptrdiff_t;
+            using value_type = const Key;
+            using pointer = const Key*;
+            using reference = const Key&;
+            using iterator_category = std::forward_iterator_tag;
+
+            iterator() = default;
+
+            reference operator*() const;
+            pointer operator->() const;
+            iterator& operator++();
+            iterator operator++(int);
+
+            bool operator==(const iterator& rhs) const;
+            bool operator!=(const iterator& rhs) const;
+
+        private:
+            //  pending ancestors, the current node on top
+            std::vector<const Node*> stack_;
+
+            void push_left(const Node* node);
+
+            friend class snapshot;
+        };
+
+        snapshot(const snapshot&) = delete;
+        snapshot(snapshot&& other) noexcept;
+        ~snapshot();
+
+        snapshot& operator=(const snapshot&) = delete;
+
+        iterator begin() const;
+        iterator end() const;
+        const Key* find(const Key& key) const;
+        bool contains(const Key& key) const;
+        iterator lower_bound(const Key& key) const;
+        bool empty() const;
+
+    private:
+        snapshot(reader_slot* slot, const rcu_set* set);
+
+        reader_slot* slot_;
+        const rcu_set* set_;
+        const Node* root_;
+
+        friend class reader;
+    };
+
+    //  Registration of one reader thread. Taking a snapshot is wait-free;
+    //  a reader holds at most one snapshot at a time.
+    class reader {
+    public:
+        reader(const reader&) = delete;
+        reader(reader&& other) noexcept;
+        ~reader();
+
+        reader& operator=(const reader&) = delete;
+
+        snapshot pin() const;
+        bool contains(const Key& key) const;
+
+    private:
+        reader(rcu_set* set, reader_slot* slot);
+
+        rcu_set* set_;
+        reader_slot* slot_;
+
+        friend class rcu_set;
+    };
+
+    rcu_set() = default;
+    explicit rcu_set(const Compare& cmp);
+    rcu_set(const rcu_set&) = delete;
+    ~rcu_set();
+
+    rcu_set& operator=(const rcu_set&) = delete;
+
+    reader make_reader();
+
+    bool insert(const Key& key);
+    bool erase(const Key& key);
+    void clear();
+    //  Exact on the writer thread, possibly behind the latest update on others.
+    size_t size() const;
+    //  Writer-side lookup, no snapshot needed.
+    bool contains(const Key& key) const;
+    //  Frees every retired node no reader can reach any more. Updates call
+    //  it on their own once enough nodes are waiting.
+    void reclaim();
+    size_t retired() const;
+
+private:
+    std::atomic<const Node*> root_{nullptr};
+    std::atomic<uint64_t> epoch_{0};
+    std::atomic<size_t> size_{0};
+    Compare cmp_;
+    uint64_t version_ = 0;
+    std::vector<std::pair<const Node*, uint64_t>> retired_;
+    size_t reclaim_at_ = 64;
+
+    mutable std::mutex readers_mutex_;
+    std::vector<std::unique_ptr<reader_slot>> readers_;
+
+    const Node* make(const Key& key, const Node* left, const Node* right);
+    void discard(const Node* node);
+    const Node* balance(const Key& key, const Node* left, const Node* right);
+    const Node* insert(const Node* node, const Key& key, bool& inserted);
+    const Node* erase(const Node* node, const Key& key, bool& erased);
+    const Node* erase_min(const Node* node, const Node*& min);
+    void publish(const Node* root);
+    void destroy(const Node* node);
+
+    static size_t height(const Node* node);
+    const Node* lower_bound(const Node* node, const Key& key) const;
+};
+
+
+//  ----------------------------------------
+//  |      RCU SET METHODS DEFINITIONS     |
+//  ----------------------------------------
+
+
+template<class Key, class Compare>
+rcu_set<Key, Compare>::rcu_set(const Compare &cmp):
+    cmp_(cmp)
+{}
+
+template<class Key, class Compare>
+rcu_set<Key, Compare>::~rcu_set() {
+    destroy(root_.load(std::memory_order_relaxed));
+    for(auto& item: retired_){
+        delete item.first;
+    }
+}
+
+template<class Key, class Compare>
+typename rcu_set<Key, Compare>::reader rcu_set<Key, Compare>::make_reader() {
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    for(auto& slot: readers_){
+        if(!slot->used){
+            slot->used = true;
+            return reader(this, slot.get());
+        }
+    }
+    readers_.push_back(std::make_unique<reader_slot>());
+    readers_.back()->used = true;
+    return reader(this, readers_.back().get());
+}
+
+template<class Key, class Compare>
+bool rcu_set<Key, Compare>::insert(const Key &key) {
+    ++version_;
+    bool inserted = false;
+    auto root = insert(root_.load(std::memory_order_relaxed), key, inserted);
+    if(inserted){
+        size_.store(size_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        publish(root);
+    }
+    return inserted;
+}
+
+template<class Key, class Compare>
+bool rcu_set<Key, Compare>::erase(const Key &key) {
+    ++version_;
+    bool erased = false;
+    auto root = erase(root_.load(std::memory_order_relaxed), key, erased);
+    if(erased){
+        size_.store(size_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        publish(root);
+    }
+    return erased;
+}
+
+template<class Key, class Compare>
+void rcu_set<Key, Compare>::clear() {
+    ++version_;
+    std::vector<const Node*> stack;
+    if(auto root = root_.load(std::memory_order_relaxed)){
+        stack.push_back(root);
+    }
+    while(!stack.empty()){
+        auto node = stack.back();
+        stack.pop_back();
+        if(node->left){
+            stack.push_back(node->left);
+        }
+        if(node->right){
+            stack.push_back(node->right);
+        }
+        discard(node);
+    }
+    size_.store(0, std::memory_order_relaxed);
+    publish(nullptr);
+}
+
+template<class Key, class Compare>
+size_t rcu_set<Key, Compare>::size() const {
+    return size_.load(std::memory_order_relaxed);
+}
+
+template<class Key, class Compare>
+bool rcu_set<Key, Compare>::contains(const Key &key) const {
+    auto node = lower_bound(root_.load(std::memory_order_relaxed), key);
+    return node && !cmp_(key, node->key);
+}
+
+template<class Key, class Compare>
+void rcu_set<Key, Compare>::reclaim() {
+    //  pairs with the fence of snapshot: either a reader's announcement is
+    //  seen here or that reader sees the root published before
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto oldest = idle;
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex_);
+        for(auto& slot: readers_){
+            oldest = std::min(oldest, slot->epoch.load(std::memory_order_acquire));
+        }
+    }
+    size_t kept = 0;
+    for(auto& item: retired_){
+        if(item.second < oldest){
+            delete item.first;
+        } else {
+            retired_[kept++] = item;
+        }
+    }
+    retired_.resize(kept);
+    reclaim_at_ = std::max<size_t>(64, 2 * kept);
+}
+
+template<class Key, class Compare>
+size_t rcu_set<Key, Compare>::retired() const {
+    return retired_.size();
+}
+
+
+//  ----------------------------------------
+//  |       INTERNAL RCU SET METHODS       |
+//  ----------------------------------------
+
+
+template<class Key, class Compare>
+const typename rcu_set<Key, Compare>::Node *rcu_set<Key, Compare>::make(const Key &key, const Node *left, const Node *right) {
+    auto height = static_cast<unsigned char>(std::max(rcu_set::height(left), rcu_set::height(right)) + 1);
+    return new Node{left, right, key, height, version_};
+}
+
+template<class Key, class Compare>
+void rcu_set<Key, Compare>::discard(const Node *node) {
+    if(node->version == version_){
+        delete node;
+    } else {
+        retired_.emplace_back(node, epoch_.load(std::memory_order_relaxed));
+    }
+}
+
+template<class Key, class Compare>
+const typename rcu_set<Key, Compare>::Node *rcu_set<Key, Compare>::balance(const Key &key, const Node *left, const Node *right) {
+    //  Builds the node for key over left and right, rotating fresh copies
+    //  when the heights differ by two. Consumed nodes are discarded only
+    //  after their keys have been copied.
+    if(height(right) > height(left) + 1){
+        if(height(right->left) > height(right->right)){
+            auto middle = right->left;
+            auto root = make(middle->key, make(key, left, middle->left), make(right->key, middle->right, right->right));
+            discard(middle);
+            discard(right);
+            return root;
+        }
+        auto root = make(right->key, make(key, left, right->left), right->right);
+        discard(right);
+        return root;
+    }
+    if(height(left) > height(right) + 1){
+        if(height(left->right) > height(left->left)){
+            auto middle = left->right;
+            auto root = make(middle->key, make(left->key, left->left, middle->left), make(key, middle->right, right));
+            discard(middle);
+            discard(left);
+            return root;
+        }
+        auto root = make(left->key, left->left, make(key, left->right, right));
+        discard(left);
+        return root;
+    }
+    return make(key, left, right);
+}
+
+template<class Key, class Compare>
+const typename rcu_set<Key, Compare>::Node *rcu_set<Key, Compare>::insert(const Node *node, const Key &key, bool &inserted) {
+    if(!node){
+        inserted = true;
+        return make(key, nullptr, nullptr);
+    }
+    const Node* result = node;
+    if(cmp_(key, node->key)){
+        auto left = insert(node->left, key, inserted);
+        if(inserted){
+            result = balance(node->key, left, node->right);
+        }
+    } else if(cmp_(node->key, key)){
+        auto right = insert(node->right, key, inserted);
+        if(inserted){
+            result = balance(node->key, node->left, right);
+        }
+    }
+    if(result != node){
+        discard(node);
+    }
+    return result;
+}
+
+template<class Key, class Compare>
+const typename rcu_set<Key, Compare>::Node *rcu_set<Key, Compare>::erase(const Node *node, const Key &key, bool &erased) {
+    if(!node){
+        return nullptr;
+    }
+    const Node* result = node;
+    if(cmp_(key, node->key)){
+        auto left = erase(node->left, key, erased);
+        if(erased){
+            result = balance(node->key, left, node->right);
+        }
+    } else if(cmp_(node->key, key)){
+        auto right = erase(node->right, key, erased);
+        if(erased){
+            result = balance(node->key, node->left, right);
+        }
+    } else {
+        erased = true;
+        if(!node->left || !node->right){
+            result = node->left ? node->left : node->right;
+        } else {
+            const Node* min = nullptr;
+            auto right = erase_min(node->right, min);
+            result = balance(min->key, node->left, right);
+            discard(min);
+        }
+    }
+    if(result != node){
+        discard(node);
+    }
+    return result;
+}
+
+template<class Key, class Compare>
+const typename rcu_set<Key, Compare>::Node *rcu_set<Key, Compare>::erase_min(const Node *node, const Node *&min) {
+    if(!node->left){
+        min = node;
+        return node->right;
+    }
+    auto result = balance(node->key, erase_min(node->left, min), node->right);
+    discard(node);
+    return result;
+}
+
+template<class Key, class Compare>
+void rcu_set<Key, Compare>::publish(const Node *root) {
+    root_.store(root, std::memory_order_release);
+    //  readers announcing the new epoch are guaranteed to see this root, so
+    //  everything retired so far is safe from them
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    if(retired_.size() >= reclaim_at_){
+        reclaim();
+    }
+}
+
+template<class Key, class Compare>
+void rcu_set<Key, Compare>::destroy(const Node *node) {
+    if(!node){
+        return;
+    }
+    destroy(node->left);
+    destroy(node->right);
+    delete node;
+}
+
+template<class Key, class Compare>
+size_t rcu_set<Key, Compare>::height(const Node *node) {
+    return node ? node->height : 0;
+}
+
+template<class Key, class Compare>
+const typename rcu_set<Key, Compare>::Node *rcu_set<Key, Compare>::lower_bound(const Node *node, const Key &key) const {
+    const Node* bound = nullptr;
+    while(node){
+        if(cmp_(node->key, key)){
+            node = node->right;
+        } else {
+            bound = node;
+            node = node->left;
+        }
+    }
+    return bound;
+}
+
+
+//  ----------------------------------------
+//  |      READER METHODS DEFINITIONS      |
+//  ----------------------------------------
+
+
+template<class Key, class Compare>
+rcu_set<Key, Compare>::reader::reader(rcu_set *set, reader_slot *slot):
+    set_(set), slot_(slot)
+{}
+
+template<class Key, class Compare>
+rcu_set<Key, Compare>::reader::reader(reader &&other) noexcept:
+    set_(other.set_), slot_(other.slot_)
+{
+    other.slot_ = nullptr;
+}
+
+template<class Key, class Compare>
+rcu_set<Key, Compare>::reader::~reader() {
+    if(slot_){
+        std::lock_guard<std::mutex> lock(set_->readers_mutex_);
+        slot_->epoch.store(idle, std::memory_order_release);
+        slot_->used = false;
+    }
+}
+
+template<class Key, class Compare>
+typename rcu_set<Key, Compare>::snapshot rcu_set<Key, Compare>::reader::pin() const {
+    return snapshot(slot_, set_);
+}
+
+template<class Key, class Compare>
+bool rcu_set<Key, Compare>::reader::contains(const Key &key) const {
+    return pin().contains(key);
+}
+
+
+//  ----------------------------------------
+//  |     SNAPSHOT METHODS DEFINITIONS     |
+//  ----------------------------------------
+
+
+template<class Key, class Compare>
+rcu_set<Key, Compare>::snapshot::snapshot(reader_slot *slot, const rcu_set *set):
+    slot_(slot), set_(set)
+{
+    slot_->epoch.store(set_->epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    root_ = set_->root_.load(std::memory_order_acquire);
+}
+
+template<class Key, class Compare>
+rcu_set<Key, Compare>::snapshot::snapshot(snapshot &&other) noexcept:
+    slot_(other.slot_), set_(other.set_), root_(other.root_)
+{
+    other.slot_ = nullptr;
+}
+
+template<class Key, class Compare>
+rcu_set<Key, Compare>::snapshot::~snapshot() {
+    if(slot_){
+        slot_->epoch.store(idle, std::memory_order_release);
+    }
+}
+
+template<class Key, class Compare>
+typename rcu_set<Key, Compare>::snapshot::iterator rcu_set<Key, Compare>::snapshot::begin() const {
+    iterator it;
+    it.push_left(root_);
+    return it;
+}
+
+template<class Key, class Compare>
+typename rcu_set<Key, Compare>::snapshot::iterator rcu_set<Key, Compare>::snapshot::end() const {
+    return iterator();
+}
+
+template<class Key, class Compare>
+const Key *rcu_set<Key, Compare>::snapshot::find(const Key &key) const {
+    auto node = set_->lower_bound(root_, key);
+    return node && !set_->cmp_(key, node->key) ? &node->key : nullptr;
+}
+
+template<class Key, class Compare>
+bool rcu_set<Key, Compare>::snapshot::contains(const Key &key) const {
+    return find(key) != nullptr;
+}
+
+template<class Key, class Compare>
+typename rcu_set<Key, Compare>::snapshot::iterator rcu_set<Key, Compare>::snapshot::lower_bound(const Key &key) const {
+    iterator it;
+    for(auto node = root_; node;){
+        if(set_->cmp_(node->key, key)){
+            node = node->right;
+        } else {
+            it.stack_.push_back(node);
+            node = node->left;
+        }
+    }
+    return it;
+}
+
+template<class Key, class Compare>
+bool rcu_set<Key, Compare>::snapshot::empty() const {
+    return root_ == nullptr;
+}
+
+
+template<class Key, class Compare>
+const Key &rcu_set<Key, Compare>::snapshot::iterator::operator*() const {
+    return stack_.back()->key;
+}
+
+template<class Key, class Compare>
+const Key *rcu_set<Key, Compare>::snapshot::iterator::operator->() const {
+    return &stack_.back()->key;
+}
+
+template<class Key, class Compare>
+typename rcu_set<Key, Compare>::snapshot::iterator &rcu_set<Key, Compare>::snapshot::iterator::operator++() {
+    auto node = stack_.back();
+    stack_.pop_back();
+    push_left(node->right);
+    return *this;
+}
+
+template<class Key, class Compare>
+typename rcu_set<Key, Compare>::snapshot::iterator rcu_set<Key, Compare>::snapshot::iterator::operator++(int) {
+    auto copy = *this;
+    ++*this;
+    return copy;
+}
+
+template<class Key, class Compare>
+bool rcu_set<Key, Compare>::snapshot::iterator::operator==(const iterator &rhs) const {
+    if(stack_.empty() || rhs.stack_.empty()){
+        return stack_.empty() == rhs.stack_.empty();
+    }
+    return stack_.back() == rhs.stack_.back();
+}
+
+template<class Key, class Compare>
+bool rcu_set<Key, Compare>::snapshot::iterator::operator!=(const iterator &rhs) const {
+    return !(*this == rhs);
+}
+
+template<class Key, class Compare>
+void rcu_set<Key, Compare>::snapshot::iterator::push_left(const Node *node) {
+    for(; node; node = node->left){
+        stack_.push_back(node);
+    }
+}
+
+#endif //STL_COMPATIBLE_SET_RCU_SET_HPP
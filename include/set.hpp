@@ -1,22 +1,52 @@
 #ifndef STL_COMPATIBLE_SET_SET_HPP
 #define STL_COMPATIBLE_SET_SET_HPP
 
+#include <algorithm>
 #include <functional>
 #include <iterator>
 #include <memory>
+#include <vector>
 
+#include "hash_index.hpp"
+#include "inline_array.hpp"
+#include "memory_usage.hpp"
 #include "tree.hpp"
 
-template <class Key, class Compare = std::less<Key>>
+
+//  Number of keys a set keeps inline before it moves them into a tree. Sets
+//  switch back to the inline array once they shrink to half of it. Specialise
+//  to tune per key type, 0 disables the inline mode.
+//
+//  Iterators are less stable than those of std::set. In inline mode every
+//  insert and erase shifts keys within the array and invalidates all
+//  iterators of the set, and so does an update that moves the keys into the
+//  tree or back. In tree mode an iterator stays valid until its key is
+//  erased, unless the update moves the keys back to the inline array or
+//  compacts the tree. To erase while iterating, use erase_if, or disable the
+//  inline mode for the key type.
+template <class Key>
+struct small_set_capacity {
+    static constexpr size_t value = sizeof(Key) <= 16 ? 16 : 256 / sizeof(Key);
+};
+
+
+template <class Key, class Compare = std::less<Key>, class Balance = avl_balance, class Aggregate = no_aggregate>
 class set {
-    using Node = typename Tree<Key, Compare>::Node;
+    using Node = typename Tree<Key, Compare, Balance, Aggregate>::Node;
+    using Small = InlineArray<Key, Compare, small_set_capacity<Key>::value>;
 
-    Tree<Key, Compare> tree_;
-    std::shared_ptr<Node> end_node_;
+    Tree<Key, Compare, Balance, Aggregate> tree_;
+    Small small_;
+    bool is_small_ = Small::capacity > 0;
+    HashIndex<Key, Node, Compare> index_;
+    bool finger_cache_ = false;
+    mutable const Node* finger_ = nullptr;
 public:
+    class subrange;
+
     struct iterator {
     public:
-        using difference_type = const std::ptrdiff_t;
+        using difference_type = std::ptrdiff_t;
         using value_type = const Key;
         using pointer = const Key*;
         using reference = const Key&;
@@ -38,24 +68,101 @@ public:
         bool operator!=(const iterator& rhs);
 
     private:
-        explicit iterator(std::shared_ptr<Node> ptr);
-        std::shared_ptr<Node> ptr_;
-        std::shared_ptr<Node> eptr_;
+        //  Points either to a tree node or, for small sets, to a slot of the
+        //  inline array. In the tree end() is a null node and the tree is kept
+        //  to step back from it.
+        iterator(const Node* ptr, const Tree<Key, Compare, Balance, Aggregate>* tree);
+        explicit iterator(const Key* slot);
+        const Node* ptr_ = nullptr;
+        const Key* slot_ = nullptr;
+        const Tree<Key, Compare, Balance, Aggregate>* tree_ = nullptr;
 
-        friend class set<Key, Compare>;
+        friend class set<Key, Compare, Balance, Aggregate>;
+        friend class set<Key, Compare, Balance, Aggregate>::subrange;
     };
 
     using reverse_iterator = std::reverse_iterator<iterator>;
 
+    //  Owns a node unlinked from a set, see extract. The key may be changed
+    //  through value() before the node is inserted again.
+    class node_type {
+    public:
+        node_type() = default;
+        node_type(const node_type&) = delete;
+        node_type(node_type&& other) noexcept;
+        ~node_type();
+
+        node_type& operator=(const node_type&) = delete;
+        node_type& operator=(node_type&& other) noexcept;
+
+        bool empty() const;
+        explicit operator bool() const;
+        Key& value() const;
+
+    private:
+        explicit node_type(Node* node);
+        Node* node_ = nullptr;
+
+        friend class set<Key, Compare, Balance, Aggregate>;
+    };
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+    //  Ordered slice of a set that splits into two parts of similar size, to
+    //  drive parallel loops the way TBB ranges do: keep splitting while
+    //  is_divisible() and hand the parts to different threads. The set must
+    //  not change while ranges over it are in use.
+    class subrange {
+    public:
+        subrange() = default;
+
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+        bool is_divisible() const;
+        //  Keeps the lower part and returns the upper one.
+        subrange split();
+
+    private:
+        //  Small sets use [first_slot_, last_slot_), trees the nodes from
+        //  first_ to last_ inclusive.
+        subrange(const Key* first, const Key* last);
+        subrange(const Node* first, const Node* last, const Tree<Key, Compare, Balance, Aggregate>* tree);
+        const Key* first_slot_ = nullptr;
+        const Key* last_slot_ = nullptr;
+        const Node* first_ = nullptr;
+        const Node* last_ = nullptr;
+        const Tree<Key, Compare, Balance, Aggregate>* tree_ = nullptr;
+
+        friend class set<Key, Compare, Balance, Aggregate>;
+    };
+
     set();
+    explicit set(const Balance& balance, const Aggregate& aggregate = Aggregate());
+    explicit set(const Compare& cmp, const Balance& balance = Balance(), const Aggregate& aggregate = Aggregate());
     template< class InputIt >
     set(InputIt first, InputIt last);
+    //  Bulk construction from unsorted input: the keys are sorted and
+    //  deduplicated in parallel and the tree is built bottom-up, large
+    //  subtrees as separate tasks, instead of inserting key by key.
+    template< class InputIt >
+    set(const parallel_policy& policy, InputIt first, InputIt last);
     set(std::initializer_list<Key>);
     set(const set& other);
-    set(set&& other);
+    set(set&& other) noexcept;
     ~set() = default;
 
+    //  Copy assignment reuses the nodes and hash index slots the set already
+    //  has. Moving and swapping never allocate. When both sets are in tree
+    //  mode, swap keeps iterators valid except end(); keys of an inline mode
+    //  set are moved, and iterators to them are invalidated.
     set& operator=(const set& other);
+    set& operator=(set&& other) noexcept;
+    void swap(set& other) noexcept;
 
     iterator begin() const;
     iterator end()   const;
@@ -64,12 +171,158 @@ public:
 
     void insert(const Key& key);
     void erase(const Key& key);
+    //  Range and predicate erase. The tree is cut around the range once and
+    //  erase_if relinks the survivors in a single pass, instead of one
+    //  rebalancing walk per erased key. erase(lo, hi) erases [lo, hi).
+    void erase(iterator first, iterator last);
+    void erase(const Key& lo, const Key& hi);
+    template <class Predicate>
+    size_t erase_if(Predicate pred);
+
+    //  Move elements between sets by relinking their tree nodes, without
+    //  allocating or copying keys. Small sets hold no nodes, so keys leaving
+    //  or entering the inline array are copied. merge moves every key of
+    //  source not present here and leaves the rest in source.
+    node_type extract(const Key& key);
+    node_type extract(iterator pos);
+    insert_return_type insert(node_type&& node);
+    void merge(set& source);
+    //  Moves every key not less than key into upper, which is cleared first.
+    //  The tree is cut in O(log n) and its nodes change owner as they are
+    //  (Tree::split_off); the hash indexes are rebuilt if enabled.
+    void split_off(const Key& key, set& upper);
+
+    //  Batch update from two disjoint runs of sorted unique keys: inserts
+    //  [add, add_last) and erases [drop, drop_last), relinking the whole tree
+    //  in one merge pass when the batch is large (Tree::merge_sorted).
+    //  buffered_set flushes through it.
+    void merge_sorted(const Key* add, const Key* add_last, const Key* drop, const Key* drop_last);
 
     size_t size() const;
     bool empty() const;
+    void clear();
+
+    //  Moves all tree nodes into one contiguous block, in key order or in van
+    //  Emde Boas order (tree.hpp), restoring the locality that churn spreads
+    //  over the heap. The tree keeps its shape. Runs in O(n) with a single
+    //  allocation, so it belongs in quiet periods. Invalidates every iterator,
+    //  subrange and cursor; small sets are left as they are. Extracting a
+    //  node from a compacted set then costs one allocation.
+    void compact(compact_order order = compact_order::in_order);
+
+    //  Priority queue access to the smallest and largest key. min and max read
+    //  the cached extremes in O(1); pop_min and pop_max unlink them without a
+    //  search from the root and rebalance upward only as far as heights
+    //  change, which is O(1) amortised. The set must not be empty.
+    //  extract_min_n moves up to k smallest keys in ascending order to out
+    //  and erases them as one range; it returns how many it took.
+    const Key& min() const;
+    const Key& max() const;
+    Key pop_min();
+    Key pop_max();
+    template <class OutputIt>
+    size_t extract_min_n(size_t k, OutputIt out);
+
+    memory_footprint memory_usage() const;
 
     iterator find(const Key& key) const;
     iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+
+    //  Finger search from hint: O(1) amortised when the key is close to it.
+    iterator find(iterator hint, const Key& key) const;
+    iterator lower_bound(iterator hint, const Key& key) const;
+
+    //  Makes find and lower_bound start from the node the previous lookup
+    //  ended at. Lookups then write to the set, so concurrent readers of a set
+    //  with the cache on need external synchronisation.
+    void use_finger_cache(bool enabled);
+    size_t count(const Key& key) const;
+    bool contains(const Key& key) const;
+
+    //  Opt-in hash side index from key to node: find, count and contains
+    //  become O(1) expected while ordered operations keep using the tree.
+    //  Costs about 12 bytes per key; Hash must be stateless.
+    template <class Hash = std::hash<Key>>
+    void enable_hash_index();
+    void disable_hash_index();
+    bool has_hash_index() const;
+
+    //  Range scans over [lo, hi) that walk the tree directly instead of
+    //  stepping an iterator. visit_range stops as soon as fn returns false.
+    template <class Fn>
+    void for_each_in_range(const Key& lo, const Key& hi, Fn fn) const;
+    template <class Fn>
+    bool visit_range(const Key& lo, const Key& hi, Fn fn) const;
+
+    //  Subtree aggregates (aggregate.hpp): the combination of all keys or of
+    //  the keys in [lo, hi), in O(log n) whatever the size of the range.
+    using aggregate_type = typename Aggregate::value_type;
+    aggregate_type aggregate() const;
+    aggregate_type aggregate(const Key& lo, const Key& hi) const;
+
+    //  Parallel algorithms on a thread pool with work stealing. fn and pred
+    //  are called concurrently from several threads in no particular order.
+    //  The reductions combine partial results in key order: combine must be
+    //  associative with identity as neutral element. Small sets run on the
+    //  calling thread.
+    template <class Fn>
+    void parallel_for_each(Fn fn, thread_pool& pool = thread_pool::shared()) const;
+    template <class T, class Combine>
+    T parallel_reduce(T identity, Combine combine, thread_pool& pool = thread_pool::shared()) const;
+    template <class T, class Combine, class Transform>
+    T parallel_transform_reduce(T identity, Combine combine, Transform transform,
+                                thread_pool& pool = thread_pool::shared()) const;
+    template <class Predicate>
+    size_t parallel_count_if(Predicate pred, thread_pool& pool = thread_pool::shared()) const;
+    subrange range() const;
+
+    //  Position of a bulk export, see copy_range. Invalidated by any update
+    //  of the set.
+    class cursor {
+    public:
+        cursor() = default;
+        bool done() const;
+
+    private:
+        const Key* slot_ = nullptr;
+        const Key* last_slot_ = nullptr;
+        typename Tree<Key, Compare, Balance, Aggregate>::cursor walk_;
+
+        friend class set<Key, Compare, Balance, Aggregate>;
+    };
+
+    cursor make_cursor() const;
+    cursor make_cursor(const Key& from) const;
+    //  Copies up to n consecutive keys into out and returns how many were
+    //  copied. The cursor overload advances from, so the next call resumes
+    //  where this one stopped without searching the tree again; the key
+    //  overload starts at the first key not less than from.
+    template <class OutputIt>
+    size_t copy_range(cursor& from, OutputIt out, size_t n) const;
+    template <class OutputIt>
+    size_t copy_range(const Key& from, OutputIt out, size_t n) const;
+
+private:
+    iterator make_iterator(const Node* node) const;
+    iterator make_iterator(const Key* slot) const;
+
+    void to_tree();
+    void to_small();
+    void rebuild_index();
+    void erase_range(const Key* lo, const Key* hi);
+    //  Restores the inline mode or the index after the tree lost keys in bulk.
+    void settle(size_t erased);
+    //  Takes a detached node unless its key is present; node is reset to null
+    //  once the set owns it.
+    iterator link(Node*& node);
+    //  Frees a node unlinked from the tree and returns its key. The node may
+    //  be a heap copy of the one that was linked (Tree::compact), so callers
+    //  drop the finger before unlinking.
+    Key release(Node* node);
+    aggregate_type fold(const Key* first, const Key* last) const;
+    const Node* lower_bound_node(const Node* hint, const Key& key) const;
 };
 
 //  ----------------------------------------
@@ -77,133 +330,927 @@ public:
 //  ----------------------------------------
 
 
-template<class Key, class Compare>
-set<Key, Compare>::set():
-    tree_(Tree<Key,Compare>())
-{
-    end_node_ = std::make_shared<Node>();
-}
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::set():
+    tree_(Tree<Key, Compare, Balance, Aggregate>())
+{}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::set(const Balance &balance, const Aggregate &aggregate):
+    tree_(balance, aggregate)
+{}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::set(const Compare &cmp, const Balance &balance, const Aggregate &aggregate):
+    tree_(cmp, balance, aggregate), small_(cmp)
+{}
 
 
-template<class Key, class Compare>
-set<Key, Compare>::set(std::initializer_list<Key> list):
-    tree_(Tree<Key,Compare>())
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::set(std::initializer_list<Key> list):
+    tree_(Tree<Key, Compare, Balance, Aggregate>())
 {
-    end_node_ = std::make_shared<Node>();
     for(auto item: list){
         insert(item);
     }
-    end_node_->parent = tree_.max_node();
 }
 
 
-template<class Key, class Compare>
-set<Key, Compare>::set(const set &other):
-    tree_(other.tree_)
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::set(const set &other):
+    tree_(other.tree_), small_(other.small_), is_small_(other.is_small_), index_(other.index_),
+    finger_cache_(other.finger_cache_)
 {
-    end_node_ = std::make_shared<Node>(tree_.max_node());
+    rebuild_index();
 }
 
-template<class Key, class Compare>
-set<Key, Compare>::set(set &&other):
-    tree_(std::move(other.tree_)), end_node_(std::move(other.end_node_))
-    {}
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::set(set &&other) noexcept:
+    tree_(std::move(other.tree_)), small_(std::move(other.small_)), is_small_(other.is_small_),
+    index_(std::move(other.index_)), finger_cache_(other.finger_cache_), finger_(other.finger_)
+{
+    other.finger_ = nullptr;
+    other.is_small_ = Small::capacity > 0;
+}
 
 
-template<class Key, class Compare>
+template<class Key, class Compare, class Balance, class Aggregate>
 template<class InputIt>
-set<Key, Compare>::set(InputIt first, InputIt last):
-    tree_(Tree<Key, Compare>())
+set<Key, Compare, Balance, Aggregate>::set(InputIt first, InputIt last):
+    tree_(Tree<Key, Compare, Balance, Aggregate>())
 {
-    end_node_ = std::make_shared<Node>();
     while (first != last){
         insert(*first);
         ++first;
     }
 }
 
-template<class Key, class Compare>
-set<Key, Compare>&set<Key, Compare>::operator=(const set &other) {
-    tree_ = other.tree_;
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class InputIt>
+set<Key, Compare, Balance, Aggregate>::set(const parallel_policy &policy, InputIt first, InputIt last):
+    tree_(Tree<Key, Compare, Balance, Aggregate>())
+{
+    auto& pool = policy.executor();
+    auto cmp = tree_.key_comp();
+    std::vector<Key> keys(first, last);
+    parallel_sort(keys.begin(), keys.end(), cmp, pool);
+    keys.erase(std::unique(keys.begin(), keys.end(), [&cmp](const Key& lhs, const Key& rhs){
+        return !cmp(lhs, rhs);
+    }), keys.end());
 
-    end_node_->parent = tree_.max_node();
+    if(keys.size() <= Small::capacity){
+        for(const auto& key: keys){
+            small_.push_back(key);
+        }
+        return;
+    }
+    is_small_ = false;
+    tree_.assign_sorted(keys.data(), keys.data() + keys.size(), pool);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>&set<Key, Compare, Balance, Aggregate>::operator=(const set &other) {
+    if(this == &other){
+        return *this;
+    }
+    finger_ = nullptr;
+    tree_ = other.tree_;
+    small_ = other.small_;
+    is_small_ = other.is_small_;
+    if(index_.hash() != other.index_.hash()){
+        index_ = HashIndex<Key, Node, Compare>(other.index_.hash(), tree_.key_comp());
+    }
+    rebuild_index();
+    finger_cache_ = other.finger_cache_;
     return *this;
 }
 
-template<class Key, class Compare>
-typename set<Key, Compare>::iterator set<Key, Compare>::begin() const{
-    if(!tree_.min_node()){
-        return end();
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>&set<Key, Compare, Balance, Aggregate>::operator=(set &&other) noexcept {
+    if(this != &other){
+        tree_ = std::move(other.tree_);
+        small_ = std::move(other.small_);
+        is_small_ = other.is_small_;
+        index_ = std::move(other.index_);
+        finger_cache_ = other.finger_cache_;
+        finger_ = other.finger_;
+        other.finger_ = nullptr;
+        other.is_small_ = Small::capacity > 0;
     }
-    auto it = iterator(tree_.min_node());
-    it.eptr_ = end_node_;
-    return it;
+    return *this;
+}
 
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::swap(set &other) noexcept {
+    tree_.swap(other.tree_);
+    std::swap(small_, other.small_);
+    std::swap(is_small_, other.is_small_);
+    std::swap(index_, other.index_);
+    std::swap(finger_cache_, other.finger_cache_);
+    std::swap(finger_, other.finger_);
 }
 
-template<class Key, class Compare>
-typename set<Key, Compare>::iterator set<Key, Compare>::end() const{
-    auto it = iterator(end_node_);
-    it.eptr_ = end_node_;
-    return it;
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::begin() const{
+    if(is_small_){
+        return make_iterator(small_.data());
+    }
+    return make_iterator(tree_.min_node());
 }
 
-template<class Key, class Compare>
-typename set<Key, Compare>::reverse_iterator set<Key, Compare>::rbegin() const {
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::end() const{
+    if(is_small_){
+        return make_iterator(small_.data() + small_.size());
+    }
+    return make_iterator(static_cast<const Node*>(nullptr));
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::reverse_iterator set<Key, Compare, Balance, Aggregate>::rbegin() const {
     return reverse_iterator(end());
 }
 
-template<class Key, class Compare>
-typename set<Key, Compare>::reverse_iterator set<Key, Compare>::rend() const {
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::reverse_iterator set<Key, Compare, Balance, Aggregate>::rend() const {
     return reverse_iterator(begin());
 }
 
-template<class Key, class Compare>
-void set<Key, Compare>::insert(const Key &key) {
-    tree_.insert(key);
-    end_node_->parent = tree_.max_node();
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::insert(const Key &key) {
+    if(is_small_){
+        if(!small_.full() || small_.search(key)){
+            small_.insert(key);
+            return;
+        }
+        to_tree();
+    }
+    auto node = tree_.insert(key);
+    if(index_.enabled()){
+        index_.insert(node);
+    }
 }
 
-template<class Key, class Compare>
-void set<Key, Compare>::erase(const Key &key) {
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::erase(const Key &key) {
+    if(is_small_){
+        small_.erase(key);
+        return;
+    }
+    if(index_.enabled()){
+        index_.erase(key);
+    }
+    finger_ = nullptr;
     tree_.erase(key);
-    end_node_->parent = tree_.max_node();
+    if(tree_.size() <= Small::capacity / 2){
+        to_small();
+    }
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::erase(iterator first, iterator last) {
+    if(first == last){
+        return;
+    }
+    //  copies: both keys live in storage the erase may free
+    Key lo = *first;
+    if(last == end()){
+        erase_range(&lo, nullptr);
+        return;
+    }
+    Key hi = *last;
+    erase_range(&lo, &hi);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::erase(const Key &lo, const Key &hi) {
+    if(tree_.key_comp()(lo, hi)){
+        erase_range(&lo, &hi);
+    }
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class Predicate>
+size_t set<Key, Compare, Balance, Aggregate>::erase_if(Predicate pred) {
+    if(is_small_){
+        return small_.erase_if(pred);
+    }
+    finger_ = nullptr;
+    auto erased = tree_.erase_if(pred);
+    settle(erased);
+    return erased;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::merge_sorted(const Key *add, const Key *add_last, const Key *drop, const Key *drop_last) {
+    if(is_small_){
+        for(auto key = drop; key != drop_last; ++key){
+            small_.erase(*key);
+        }
+        if(small_.size() + (add_last - add) <= Small::capacity){
+            for(auto key = add; key != add_last; ++key){
+                small_.insert(*key);
+            }
+            return;
+        }
+        drop = drop_last;
+        to_tree();
+    }
+    if(index_.enabled()){
+        for(auto key = drop; key != drop_last; ++key){
+            index_.erase(*key);
+        }
+    }
+    finger_ = nullptr;
+    tree_.merge_sorted(add, add_last, drop, drop_last);
+    if(index_.enabled()){
+        for(auto key = add; key != add_last; ++key){
+            index_.insert(tree_.search(*key));
+        }
+    }
+    if(tree_.size() <= Small::capacity / 2){
+        to_small();
+    }
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::node_type set<Key, Compare, Balance, Aggregate>::extract(const Key &key) {
+    if(is_small_){
+        auto slot = small_.search(key);
+        if(!slot){
+            return node_type();
+        }
+        auto node = new Node(*slot);
+        small_.erase(node->key);
+        return node_type(node);
+    }
+    if(index_.enabled()){
+        index_.erase(key);
+    }
+    finger_ = nullptr;
+    auto node = tree_.extract(key);
+    if(tree_.size() <= Small::capacity / 2){
+        to_small();
+    }
+    return node_type(node);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::node_type set<Key, Compare, Balance, Aggregate>::extract(iterator pos) {
+    return extract(*pos);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::insert_return_type set<Key, Compare, Balance, Aggregate>::insert(node_type &&node) {
+    if(node.empty()){
+        return {end(), false, node_type()};
+    }
+    auto detached = node.node_;
+    node.node_ = nullptr;
+    auto position = link(detached);
+    return {position, detached == nullptr, node_type(detached)};
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::merge(set &source) {
+    if(&source == this){
+        return;
+    }
+    if(source.is_small_){
+        source.small_.erase_if([this](const Key& key){
+            if(contains(key)){
+                return false;
+            }
+            insert(key);
+            return true;
+        });
+        return;
+    }
+    source.finger_ = nullptr;
+    auto moved = source.tree_.extract_if([this](const Key& key){
+        return !contains(key);
+    }, [this](Node* node){
+        link(node);
+    });
+    source.settle(moved);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::split_off(const Key &key, set &upper) {
+    if(&upper == this){
+        return;
+    }
+    upper.clear();
+    if(is_small_){
+        auto first = small_.lower_bound(key);
+        auto last = small_.data() + small_.size();
+        for(auto slot = first; slot != last; ++slot){
+            upper.small_.push_back(*slot);
+        }
+        small_.erase(first, last);
+        return;
+    }
+    finger_ = nullptr;
+    tree_.split_off(key, upper.tree_);
+    auto moved = upper.tree_.size();
+    upper.is_small_ = false;
+    upper.settle(moved);
+    settle(moved);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+size_t set<Key, Compare, Balance, Aggregate>::size() const {
+    return is_small_ ? small_.size() : tree_.size();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::empty() const {
+    return is_small_ ? small_.empty() : tree_.empty();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::clear() {
+    tree_.clear();
+    small_.clear();
+    is_small_ = Small::capacity > 0;
+    index_.reset();
+    finger_ = nullptr;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::compact(compact_order order) {
+    if(is_small_){
+        return;
+    }
+    finger_ = nullptr;
+    tree_.compact(order);
+    rebuild_index();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+const Key &set<Key, Compare, Balance, Aggregate>::min() const {
+    if(is_small_){
+        return small_.data()[0];
+    }
+    return tree_.min_node()->key;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+const Key &set<Key, Compare, Balance, Aggregate>::max() const {
+    if(is_small_){
+        return small_.data()[small_.size() - 1];
+    }
+    return tree_.max_node()->key;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+Key set<Key, Compare, Balance, Aggregate>::pop_min() {
+    if(is_small_){
+        Key key = small_.data()[0];
+        small_.erase(small_.data(), small_.data() + 1);
+        return key;
+    }
+    if(index_.enabled()){
+        index_.erase(tree_.min_node()->key);
+    }
+    finger_ = nullptr;
+    return release(tree_.extract_min());
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+Key set<Key, Compare, Balance, Aggregate>::pop_max() {
+    if(is_small_){
+        Key key = small_.data()[small_.size() - 1];
+        small_.erase(small_.data() + small_.size() - 1, small_.data() + small_.size());
+        return key;
+    }
+    if(index_.enabled()){
+        index_.erase(tree_.max_node()->key);
+    }
+    finger_ = nullptr;
+    return release(tree_.extract_max());
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class OutputIt>
+size_t set<Key, Compare, Balance, Aggregate>::extract_min_n(size_t k, OutputIt out) {
+    size_t taken = 0;
+    auto it = begin();
+    auto last = end();
+    for(; taken < k && it != last; ++it, ++taken){
+        *out++ = *it;
+    }
+    if(!taken){
+        return 0;
+    }
+    //  copies: both keys live in storage the erase frees
+    Key lo = min();
+    if(it == last){
+        erase_range(&lo, nullptr);
+    } else {
+        Key hi = *it;
+        erase_range(&lo, &hi);
+    }
+    return taken;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+memory_footprint set<Key, Compare, Balance, Aggregate>::memory_usage() const {
+    auto usage = tree_.memory_usage();
+    usage.object_bytes = sizeof(*this);
+    usage.overhead_bytes += index_.memory_usage();
+    for(size_t i = 0; i < small_.size(); ++i){
+        usage.key_bytes += key_memory<Key>::out_of_line(small_.data()[i]);
+    }
+    return usage;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::find(const Key &key) const {
+    if(is_small_){
+        auto slot = small_.search(key);
+        return slot ? make_iterator(slot) : end();
+    }
+    if(index_.enabled()){
+        return make_iterator(index_.find(key));
+    }
+    if(finger_cache_){
+        auto node = lower_bound_node(finger_, key);
+        return node && !tree_.key_comp()(key, node->key) ? make_iterator(node) : end();
+    }
+    return make_iterator(tree_.search(key));
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::lower_bound(const Key &key) const {
+    if(is_small_){
+        return make_iterator(small_.lower_bound(key));
+    }
+    if(finger_cache_){
+        return make_iterator(lower_bound_node(finger_, key));
+    }
+    return make_iterator(tree_.lower_bound(key));
 }
 
-template<class Key, class Compare>
-size_t set<Key, Compare>::size() const {
-    return tree_.size();
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::upper_bound(const Key &key) const {
+    if(is_small_){
+        return make_iterator(small_.upper_bound(key));
+    }
+    return make_iterator(tree_.upper_bound(key));
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+std::pair<typename set<Key, Compare, Balance, Aggregate>::iterator, typename set<Key, Compare, Balance, Aggregate>::iterator>
+set<Key, Compare, Balance, Aggregate>::equal_range(const Key &key) const {
+    return {lower_bound(key), upper_bound(key)};
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::find(iterator hint, const Key &key) const {
+    if(is_small_){
+        return find(key);
+    }
+    auto node = lower_bound_node(hint.ptr_ ? hint.ptr_ : tree_.max_node(), key);
+    return node && !tree_.key_comp()(key, node->key) ? make_iterator(node) : end();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::lower_bound(iterator hint, const Key &key) const {
+    if(is_small_){
+        return lower_bound(key);
+    }
+    return make_iterator(lower_bound_node(hint.ptr_ ? hint.ptr_ : tree_.max_node(), key));
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::use_finger_cache(bool enabled) {
+    finger_cache_ = enabled;
+    finger_ = nullptr;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+size_t set<Key, Compare, Balance, Aggregate>::count(const Key &key) const {
+    if(is_small_){
+        return small_.search(key) ? 1 : 0;
+    }
+    if(index_.enabled()){
+        return index_.find(key) ? 1 : 0;
+    }
+    return tree_.search(key) ? 1 : 0;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::contains(const Key &key) const {
+    return count(key) != 0;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class Hash>
+void set<Key, Compare, Balance, Aggregate>::enable_hash_index() {
+    index_ = HashIndex<Key, Node, Compare>(+[](const Key& key) -> size_t {
+        return Hash()(key);
+    }, tree_.key_comp());
+    rebuild_index();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::disable_hash_index() {
+    index_ = HashIndex<Key, Node, Compare>();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::has_hash_index() const {
+    return index_.enabled();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class Fn>
+void set<Key, Compare, Balance, Aggregate>::for_each_in_range(const Key &lo, const Key &hi, Fn fn) const {
+    visit_range(lo, hi, [&fn](const Key& key){
+        fn(key);
+        return true;
+    });
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class Fn>
+bool set<Key, Compare, Balance, Aggregate>::visit_range(const Key &lo, const Key &hi, Fn fn) const {
+    if(is_small_){
+        auto last = small_.lower_bound(hi);
+        for(auto slot = small_.lower_bound(lo); slot < last; ++slot){
+            if(!fn(*slot)){
+                return false;
+            }
+        }
+        return true;
+    }
+    return tree_.visit_range(lo, hi, fn);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::aggregate_type set<Key, Compare, Balance, Aggregate>::aggregate() const {
+    if(is_small_){
+        return fold(small_.data(), small_.data() + small_.size());
+    }
+    return tree_.aggregate();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::aggregate_type set<Key, Compare, Balance, Aggregate>::aggregate(const Key &lo, const Key &hi) const {
+    if(is_small_){
+        if(!tree_.key_comp()(lo, hi)){
+            return tree_.aggregate_policy().identity();
+        }
+        return fold(small_.lower_bound(lo), small_.lower_bound(hi));
+    }
+    return tree_.aggregate(lo, hi);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class Fn>
+void set<Key, Compare, Balance, Aggregate>::parallel_for_each(Fn fn, thread_pool &pool) const {
+    if(is_small_){
+        for(size_t i = 0; i < small_.size(); ++i){
+            fn(small_.data()[i]);
+        }
+        return;
+    }
+    tree_.parallel_for_each(fn, pool);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class T, class Combine>
+T set<Key, Compare, Balance, Aggregate>::parallel_reduce(T identity, Combine combine, thread_pool &pool) const {
+    return parallel_transform_reduce(std::move(identity), combine, [](const Key& key) -> const Key& {
+        return key;
+    }, pool);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class T, class Combine, class Transform>
+T set<Key, Compare, Balance, Aggregate>::parallel_transform_reduce(T identity, Combine combine, Transform transform,
+                                                                   thread_pool &pool) const {
+    if(is_small_){
+        for(size_t i = 0; i < small_.size(); ++i){
+            identity = combine(std::move(identity), transform(small_.data()[i]));
+        }
+        return identity;
+    }
+    return tree_.parallel_transform_reduce(std::move(identity), combine, transform, pool);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class Predicate>
+size_t set<Key, Compare, Balance, Aggregate>::parallel_count_if(Predicate pred, thread_pool &pool) const {
+    return parallel_transform_reduce(size_t(0), std::plus<size_t>(), [&pred](const Key& key) -> size_t {
+        return pred(key) ? 1 : 0;
+    }, pool);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::subrange set<Key, Compare, Balance, Aggregate>::range() const {
+    if(is_small_){
+        return subrange(small_.data(), small_.data() + small_.size());
+    }
+    return subrange(tree_.min_node(), tree_.max_node(), &tree_);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::cursor set<Key, Compare, Balance, Aggregate>::make_cursor() const {
+    cursor result;
+    if(is_small_){
+        result.slot_ = small_.data();
+        result.last_slot_ = small_.data() + small_.size();
+    } else {
+        result.walk_ = typename Tree<Key, Compare, Balance, Aggregate>::cursor(tree_);
+    }
+    return result;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::cursor set<Key, Compare, Balance, Aggregate>::make_cursor(const Key &from) const {
+    cursor result;
+    if(is_small_){
+        result.slot_ = small_.lower_bound(from);
+        result.last_slot_ = small_.data() + small_.size();
+    } else {
+        result.walk_ = typename Tree<Key, Compare, Balance, Aggregate>::cursor(tree_, from);
+    }
+    return result;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class OutputIt>
+size_t set<Key, Compare, Balance, Aggregate>::copy_range(cursor &from, OutputIt out, size_t n) const {
+    size_t copied = 0;
+    if(from.slot_){
+        for(; copied < n && from.slot_ != from.last_slot_; ++copied){
+            *out = *from.slot_++;
+            ++out;
+        }
+        return copied;
+    }
+    for(; copied < n && !from.walk_.done(); ++copied){
+        *out = from.walk_.next()->key;
+        ++out;
+    }
+    return copied;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+template<class OutputIt>
+size_t set<Key, Compare, Balance, Aggregate>::copy_range(const Key &from, OutputIt out, size_t n) const {
+    auto position = make_cursor(from);
+    return copy_range(position, out, n);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::aggregate_type set<Key, Compare, Balance, Aggregate>::fold(const Key *first, const Key *last) const {
+    auto& policy = tree_.aggregate_policy();
+    auto value = policy.identity();
+    for(; first != last; ++first){
+        value = policy.combine(value, policy.lift(*first));
+    }
+    return value;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::make_iterator(const Node* node) const {
+    return iterator(node, &tree_);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::make_iterator(const Key* slot) const {
+    return iterator(slot);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::to_tree() {
+    for(size_t i = 0; i < small_.size(); ++i){
+        tree_.insert(small_.data()[i]);
+    }
+    small_.clear();
+    is_small_ = false;
+    rebuild_index();
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::to_small() {
+    if(Small::capacity == 0){
+        return;
+    }
+    for(auto node = tree_.min_node(); node; node = tree_.next(node)){
+        small_.push_back(node->key);
+    }
+    tree_.clear();
+    is_small_ = true;
+    index_.clear();
+    finger_ = nullptr;
 }
 
-template<class Key, class Compare>
-bool set<Key, Compare>::empty() const {
-    return tree_.empty();
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::erase_range(const Key *lo, const Key *hi) {
+    if(is_small_){
+        small_.erase(small_.lower_bound(*lo), hi ? small_.lower_bound(*hi) : small_.data() + small_.size());
+        return;
+    }
+    if(index_.enabled()){
+        for(auto node = tree_.lower_bound(*lo); node && (!hi || tree_.key_comp()(node->key, *hi)); node = tree_.next(node)){
+            index_.erase(node->key);
+        }
+    }
+    finger_ = nullptr;
+    if(hi){
+        tree_.erase(*lo, *hi);
+    } else {
+        tree_.erase_from(*lo);
+    }
+    if(tree_.size() <= Small::capacity / 2){
+        to_small();
+    }
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::settle(size_t erased) {
+    if(tree_.size() <= Small::capacity / 2){
+        to_small();
+    } else if(erased){
+        rebuild_index();
+    }
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::link(Node *&node) {
+    if(is_small_){
+        if(auto slot = small_.search(node->key)){
+            return make_iterator(slot);
+        }
+        if(!small_.full()){
+            small_.insert(node->key);
+            auto slot = small_.search(node->key);
+            delete node;
+            node = nullptr;
+            return make_iterator(slot);
+        }
+        to_tree();
+    }
+    auto held = tree_.insert(node);
+    if(held != node){
+        return make_iterator(held);
+    }
+    if(index_.enabled()){
+        index_.insert(node);
+    }
+    node = nullptr;
+    return make_iterator(held);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+Key set<Key, Compare, Balance, Aggregate>::release(Node *node) {
+    Key key = std::move(node->key);
+    delete node;
+    if(tree_.size() <= Small::capacity / 2){
+        to_small();
+    }
+    return key;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+const typename set<Key, Compare, Balance, Aggregate>::Node*
+set<Key, Compare, Balance, Aggregate>::lower_bound_node(const Node *hint, const Key &key) const {
+    auto node = tree_.lower_bound(hint, key);
+    if(finger_cache_ && node){
+        finger_ = node;
+    }
+    return node;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+void set<Key, Compare, Balance, Aggregate>::rebuild_index() {
+    if(is_small_ || !index_.enabled()){
+        index_.clear();
+        return;
+    }
+    index_.reset();
+    index_.reserve(tree_.size());
+    for(auto node = tree_.min_node(); node; node = tree_.next(node)){
+        index_.insert(node);
+    }
+}
+
+
+//  --------------------------------------------
+//  |      NODE HANDLE METHODS DEFINITION      |
+//  --------------------------------------------
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::node_type::node_type(Node *node):
+    node_(node)
+{}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::node_type::node_type(node_type &&other) noexcept:
+    node_(other.node_)
+{
+    other.node_ = nullptr;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::node_type::~node_type() {
+    delete node_;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::node_type &set<Key, Compare, Balance, Aggregate>::node_type::operator=(node_type &&other) noexcept {
+    if(this != &other){
+        delete node_;
+        node_ = other.node_;
+        other.node_ = nullptr;
+    }
+    return *this;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::node_type::empty() const {
+    return node_ == nullptr;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::node_type::operator bool() const {
+    return node_ != nullptr;
 }
 
-template<class Key, class Compare>
-typename set<Key, Compare>::iterator set<Key, Compare>::find(const Key &key) const {
-    auto node = tree_.search(key);
-    if(!node){
-        iterator it(end_node_);
-        it.eptr_=end_node_;
-        return it;
+template<class Key, class Compare, class Balance, class Aggregate>
+Key &set<Key, Compare, Balance, Aggregate>::node_type::value() const {
+    return node_->key;
+}
+
+
+//  --------------------------------------------
+//  |       SUBRANGE METHODS DEFINITION        |
+//  --------------------------------------------
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::subrange::subrange(const Key *first, const Key *last):
+    first_slot_(first), last_slot_(last)
+{}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::subrange::subrange(const Node *first, const Node *last,
+                                                         const Tree<Key, Compare, Balance, Aggregate> *tree):
+    first_(first), last_(last), tree_(tree)
+{}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::subrange::begin() const {
+    if(!tree_){
+        return iterator(first_slot_);
     }
-    iterator it(node);
-    it.eptr_=end_node_;
-    return it;
+    return iterator(first_, tree_);
 }
 
-template<class Key, class Compare>
-typename set<Key, Compare>::iterator set<Key, Compare>::lower_bound(const Key &key) const {
-    auto node = tree_.lower_bound(key);
-    if(!node){
-        iterator it(end_node_);
-        it.eptr_=end_node_;
-        return it;
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::subrange::end() const {
+    if(!tree_){
+        return iterator(last_slot_);
     }
-    iterator it(node);
-    it.eptr_=end_node_;
-    return it;
+    return iterator(last_ ? tree_->next(last_) : nullptr, tree_);
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::subrange::empty() const {
+    return tree_ ? !first_ : first_slot_ == last_slot_;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::subrange::is_divisible() const {
+    return tree_ ? first_ && first_ != last_ : last_slot_ - first_slot_ > 1;
+}
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::subrange set<Key, Compare, Balance, Aggregate>::subrange::split() {
+    if(!tree_){
+        auto middle = first_slot_ + (last_slot_ - first_slot_) / 2;
+        subrange upper(middle, last_slot_);
+        last_slot_ = middle;
+        return upper;
+    }
+    //  Cut in front of the topmost node of the range. When that is the first
+    //  node, the rest lies in its right subtree: cut there one level down.
+    auto top = tree_->common_ancestor(first_, last_);
+    if(top == first_){
+        top = tree_->common_ancestor(tree_->next(first_), last_);
+    }
+    subrange upper(top, last_, tree_);
+    last_ = tree_->prev(top);
+    return upper;
+}
+
+
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::cursor::done() const {
+    return slot_ ? slot_ == last_slot_ : walk_.done();
 }
 
 
@@ -211,57 +1258,64 @@ typename set<Key, Compare>::iterator set<Key, Compare>::lower_bound(const Key &k
 //  |       ITERATOR METHODS DEFINITION        |
 //  --------------------------------------------
 
-template<class Key, class Compare>
-set<Key, Compare>::iterator::iterator(const set::iterator &other):
-ptr_(other.ptr_), eptr_(other.eptr_)
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::iterator::iterator(const set::iterator &other):
+ptr_(other.ptr_), slot_(other.slot_), tree_(other.tree_)
 {}
 
-template<class Key, class Compare>
-typename set<Key, Compare>::iterator &set<Key, Compare>::iterator::operator=(const iterator& other){
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator &set<Key, Compare, Balance, Aggregate>::iterator::operator=(const iterator& other){
     ptr_ = other.ptr_;
-    eptr_ = other.eptr_;
+    slot_ = other.slot_;
+    tree_ = other.tree_;
     return *this;
 }
 
 
-template<class Key, class Compare>
-const Key &set<Key, Compare>::iterator::operator*() {
-    return ptr_->key;
+template<class Key, class Compare, class Balance, class Aggregate>
+const Key &set<Key, Compare, Balance, Aggregate>::iterator::operator*() {
+    return slot_ ? *slot_ : ptr_->key;
 }
 
-template<class Key, class Compare>
-const Key* set<Key, Compare>::iterator::operator->() {
-    return &ptr_->key;
+template<class Key, class Compare, class Balance, class Aggregate>
+const Key* set<Key, Compare, Balance, Aggregate>::iterator::operator->() {
+    return slot_ ? slot_ : &ptr_->key;
 }
 
-template<class Key, class Compare>
-bool set<Key, Compare>::iterator::operator==(const iterator &rhs) {
-    return ptr_ == rhs.ptr_;
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::iterator::operator==(const iterator &rhs) {
+    return ptr_ == rhs.ptr_ && slot_ == rhs.slot_;
 }
 
-template<class Key, class Compare>
-bool set<Key, Compare>::iterator::operator!=(const iterator &rhs) {
+template<class Key, class Compare, class Balance, class Aggregate>
+bool set<Key, Compare, Balance, Aggregate>::iterator::operator!=(const iterator &rhs) {
 
-    return ptr_ != rhs.ptr_;
+    return ptr_ != rhs.ptr_ || slot_ != rhs.slot_;
 }
 
-template<class Key, class Compare>
-set<Key, Compare>::iterator::iterator(std::shared_ptr<Node> ptr):
-    ptr_(ptr)
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::iterator::iterator(const Node* ptr, const Tree<Key, Compare, Balance, Aggregate>* tree):
+    ptr_(ptr), tree_(tree)
     {}
 
+template<class Key, class Compare, class Balance, class Aggregate>
+set<Key, Compare, Balance, Aggregate>::iterator::iterator(const Key* slot):
+    slot_(slot)
+    {}
 
 
-template<class Key, class Compare>
-typename set<Key, Compare>::iterator &set<Key, Compare>::iterator::operator++() {
+
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator &set<Key, Compare, Balance, Aggregate>::iterator::operator++() {
+    if(slot_){
+        ++slot_;
+        return *this;
+    }
     if(!ptr_->right){
-        while(ptr_->parent.lock() && ptr_->parent.lock()->right == ptr_){
-            ptr_ = ptr_->parent.lock();
-        }
-        ptr_ = ptr_->parent.lock();
-        if(!ptr_){
-            ptr_ = eptr_;
+        while(ptr_->parent && ptr_->parent->right == ptr_){
+            ptr_ = ptr_->parent;
         }
+        ptr_ = ptr_->parent;
         return *this;
     }
     ptr_ = ptr_->right;
@@ -271,16 +1325,21 @@ typename set<Key, Compare>::iterator &set<Key, Compare>::iterator::operator++()
     return *this;
 }
 
-template<class Key, class Compare>
-typename set<Key, Compare>::iterator &set<Key, Compare>::iterator::operator--() {
+template<class Key, class Compare, class Balance, class Aggregate>
+typename set<Key, Compare, Balance, Aggregate>::iterator &set<Key, Compare, Balance, Aggregate>::iterator::operator--() {
+    if(slot_){
+        --slot_;
+        return *this;
+    }
+    if(!ptr_){
+        ptr_ = tree_->max_node();
+        return *this;
+    }
     if(!ptr_->left){
-        while (ptr_->parent.lock() && ptr_->parent.lock()->left == ptr_){
-            ptr_ = ptr_->parent.lock();
-        }
-        ptr_ = ptr_->parent.lock();
-        if(!ptr_){
-            ptr_ = eptr_;
+        while (ptr_->parent && ptr_->parent->left == ptr_){
+            ptr_ = ptr_->parent;
         }
+        ptr_ = ptr_->parent;
         return *this;
     }
     ptr_ = ptr_->left;
@@ -290,18 +1349,23 @@ typename set<Key, Compare>::iterator &set<Key, Compare>::iterator::operator--()
     return *this;
 }
 
-template<class Key, class Compare>
- typename set<Key, Compare>::iterator set<Key, Compare>::iterator::operator++(int){
+template<class Key, class Compare, class Balance, class Aggregate>
+ typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::iterator::operator++(int){
     auto tmp = *this;
     ++*this;
     return tmp;
 }
 
-template<class Key, class Compare>
- typename set<Key, Compare>::iterator set<Key, Compare>::iterator::operator--(int){
+template<class Key, class Compare, class Balance, class Aggregate>
+ typename set<Key, Compare, Balance, Aggregate>::iterator set<Key, Compare, Balance, Aggregate>::iterator::operator--(int){
     auto tmp = *this;
     --*this;
     return tmp;
 }
 
+template<class Key, class Compare, class Balance, class Aggregate>
+void swap(set<Key, Compare, Balance, Aggregate>& lhs, set<Key, Compare, Balance, Aggregate>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
 #endif //STL_COMPATIBLE_SET_SET_HPP
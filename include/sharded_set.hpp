@@ -0,0 +1,292 @@
+#ifndef STL_COMPATIBLE_SET_SHARDED_SET_HPP
+#define STL_COMPATIBLE_SET_SHARDED_SET_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+#include "set.hpp"
+
+
+//  Ordered set split by key range into shards, each a set behind its own
+//  mutex, so that writers to different ranges run in parallel. The shard
+//  boundaries sit in a directory guarded by a reader-writer lock: every
+//  operation holds it shared, only restructuring holds it exclusively.
+//
+//  A shard growing past shard_capacity is split at its median, so ranges that
+//  receive many inserts end up spread over many shards. Neighbouring shards
+//  that together shrink below a quarter of the capacity are merged again.
+//  Restructuring is not O(log n): the trees keep no subtree sizes, so a split
+//  walks half of the shard to find the median, blocking only that shard, and
+//  then the moved half to count it, blocking the whole set. Both walks are
+//  O(shard_capacity) pointer steps without allocation.
+//
+//  Keys are returned by value and iteration goes through callbacks, since no
+//  reference into a shard stays valid once its lock is released.
+template <class Key, class Compare = std::less<Key>, class Balance = avl_balance>
+class sharded_set {
+public:
+    explicit sharded_set(size_t shard_capacity = 1 << 16, const Compare& cmp = Compare());
+    sharded_set(const sharded_set&) = delete;
+
+    sharded_set& operator=(const sharded_set&) = delete;
+
+    bool insert(const Key& key);
+    bool erase(const Key& key);
+    bool contains(const Key& key) const;
+    std::optional<Key> lower_bound(const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+    size_t shard_count() const;
+
+    //  Calls fn for every key in order. Each shard is locked while it is
+    //  visited, so the walk sees every shard in a consistent state but not
+    //  the whole set at one point in time. fn must not modify the set.
+    template <class Fn>
+    void for_each(Fn fn) const;
+    //  Same for the keys in [lo, hi).
+    template <class Fn>
+    void for_each_in_range(const Key& lo, const Key& hi, Fn fn) const;
+
+private:
+    struct shard {
+        explicit shard(const Compare& cmp);
+
+        mutable std::mutex mutex;
+        set<Key, Compare, Balance> keys;
+    };
+
+    //  bounds_[i] is the smallest key shard i + 1 may hold
+    std::vector<Key> bounds_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    mutable std::shared_mutex directory_;
+    std::atomic<size_t> size_{0};
+    size_t shard_capacity_;
+    Compare cmp_;
+
+    size_t locate(const Key& key) const;
+    template <class Fn>
+    bool visit(size_t first, const Key* lo, const Key* hi, Fn& fn) const;
+    void split(const Key& key);
+    void merge(const Key& key);
+};
+
+
+//  ----------------------------------------
+//  |   SHARDED SET METHODS DEFINITIONS    |
+//  ----------------------------------------
+
+
+template<class Key, class Compare, class Balance>
+sharded_set<Key, Compare, Balance>::sharded_set(size_t shard_capacity, const Compare &cmp):
+    shard_capacity_(std::max<size_t>(shard_capacity, 4)), cmp_(cmp)
+{
+    shards_.push_back(std::make_unique<shard>(cmp_));
+}
+
+template<class Key, class Compare, class Balance>
+bool sharded_set<Key, Compare, Balance>::insert(const Key &key) {
+    bool inserted;
+    bool full;
+    {
+        std::shared_lock<std::shared_mutex> directory(directory_);
+        auto& target = *shards_[locate(key)];
+        std::lock_guard<std::mutex> lock(target.mutex);
+        auto before = target.keys.size();
+        target.keys.insert(key);
+        inserted = target.keys.size() != before;
+        full = target.keys.size() > shard_capacity_;
+    }
+    if(inserted){
+        ++size_;
+    }
+    if(full){
+        split(key);
+    }
+    return inserted;
+}
+
+template<class Key, class Compare, class Balance>
+bool sharded_set<Key, Compare, Balance>::erase(const Key &key) {
+    bool erased;
+    bool sparse;
+    {
+        std::shared_lock<std::shared_mutex> directory(directory_);
+        auto& target = *shards_[locate(key)];
+        std::lock_guard<std::mutex> lock(target.mutex);
+        auto before = target.keys.size();
+        target.keys.erase(key);
+        erased = target.keys.size() != before;
+        sparse = erased && shards_.size() > 1 && target.keys.size() < shard_capacity_ / 8;
+    }
+    if(erased){
+        --size_;
+    }
+    if(sparse){
+        merge(key);
+    }
+    return erased;
+}
+
+template<class Key, class Compare, class Balance>
+bool sharded_set<Key, Compare, Balance>::contains(const Key &key) const {
+    std::shared_lock<std::shared_mutex> directory(directory_);
+    auto& target = *shards_[locate(key)];
+    std::lock_guard<std::mutex> lock(target.mutex);
+    return target.keys.contains(key);
+}
+
+template<class Key, class Compare, class Balance>
+std::optional<Key> sharded_set<Key, Compare, Balance>::lower_bound(const Key &key) const {
+    std::optional<Key> result;
+    std::shared_lock<std::shared_mutex> directory(directory_);
+    auto stop = [&result](const Key& found){
+        result = found;
+        return false;
+    };
+    visit(locate(key), &key, nullptr, stop);
+    return result;
+}
+
+template<class Key, class Compare, class Balance>
+size_t sharded_set<Key, Compare, Balance>::size() const {
+    return size_;
+}
+
+template<class Key, class Compare, class Balance>
+bool sharded_set<Key, Compare, Balance>::empty() const {
+    return size_ == 0;
+}
+
+template<class Key, class Compare, class Balance>
+size_t sharded_set<Key, Compare, Balance>::shard_count() const {
+    std::shared_lock<std::shared_mutex> directory(directory_);
+    return shards_.size();
+}
+
+template<class Key, class Compare, class Balance>
+template<class Fn>
+void sharded_set<Key, Compare, Balance>::for_each(Fn fn) const {
+    auto visitor = [&fn](const Key& key){
+        fn(key);
+        return true;
+    };
+    std::shared_lock<std::shared_mutex> directory(directory_);
+    visit(0, nullptr, nullptr, visitor);
+}
+
+template<class Key, class Compare, class Balance>
+template<class Fn>
+void sharded_set<Key, Compare, Balance>::for_each_in_range(const Key &lo, const Key &hi, Fn fn) const {
+    auto visitor = [&fn](const Key& key){
+        fn(key);
+        return true;
+    };
+    std::shared_lock<std::shared_mutex> directory(directory_);
+    visit(locate(lo), &lo, &hi, visitor);
+}
+
+
+//  ----------------------------------------
+//  |     INTERNAL SHARDED SET METHODS     |
+//  ----------------------------------------
+
+
+template<class Key, class Compare, class Balance>
+sharded_set<Key, Compare, Balance>::shard::shard(const Compare &cmp):
+    keys(cmp)
+{}
+
+template<class Key, class Compare, class Balance>
+size_t sharded_set<Key, Compare, Balance>::locate(const Key &key) const {
+    return std::upper_bound(bounds_.begin(), bounds_.end(), key, cmp_) - bounds_.begin();
+}
+
+template<class Key, class Compare, class Balance>
+template<class Fn>
+bool sharded_set<Key, Compare, Balance>::visit(size_t first, const Key *lo, const Key *hi, Fn &fn) const {
+    //  Visits the keys in [lo, hi) from shard first on, a null bound being
+    //  open, until fn returns false. The directory must be held.
+    for(size_t i = first; i < shards_.size(); ++i){
+        if(hi && i > 0 && !cmp_(bounds_[i - 1], *hi)){
+            return true;
+        }
+        auto& current = *shards_[i];
+        std::lock_guard<std::mutex> lock(current.mutex);
+        auto it = lo && i == first ? current.keys.lower_bound(*lo) : current.keys.begin();
+        for(auto end = current.keys.end(); it != end; ++it){
+            if(hi && !cmp_(*it, *hi)){
+                return true;
+            }
+            if(!fn(*it)){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<class Key, class Compare, class Balance>
+void sharded_set<Key, Compare, Balance>::split(const Key &key) {
+    //  Cuts the upper half of the shard holding key off into a new shard, by
+    //  relinking tree nodes rather than copying keys. The median is looked up
+    //  first with only the shard locked, so readers of other shards are not
+    //  stalled by that walk.
+    std::optional<Key> median;
+    {
+        std::shared_lock<std::shared_mutex> directory(directory_);
+        auto& target = *shards_[locate(key)];
+        std::lock_guard<std::mutex> lock(target.mutex);
+        if(target.keys.size() <= shard_capacity_){
+            return;
+        }
+        auto middle = target.keys.begin();
+        std::advance(middle, target.keys.size() / 2);
+        median = *middle;
+    }
+
+    //  Other writers may have split or merged the shard in between: it must
+    //  still be full, hold the median and keep keys below it.
+    std::unique_lock<std::shared_mutex> directory(directory_);
+    auto index = locate(key);
+    auto& full = shards_[index]->keys;
+    if(full.size() <= shard_capacity_ || locate(*median) != index || !cmp_(full.min(), *median)){
+        return;
+    }
+    Key bound = *median;
+    auto upper = std::make_unique<shard>(cmp_);
+    full.split_off(bound, upper->keys);
+    bounds_.insert(bounds_.begin() + index, bound);
+    shards_.insert(shards_.begin() + index + 1, std::move(upper));
+}
+
+template<class Key, class Compare, class Balance>
+void sharded_set<Key, Compare, Balance>::merge(const Key &key) {
+    //  Folds the shard holding key into its smaller neighbour when both fit
+    //  in a quarter of the capacity.
+    std::unique_lock<std::shared_mutex> directory(directory_);
+    if(shards_.size() < 2){
+        return;
+    }
+    auto index = locate(key);
+    auto neighbour = index == 0 ? 1 : index + 1 == shards_.size() ||
+        shards_[index - 1]->keys.size() <= shards_[index + 1]->keys.size() ? index - 1 : index + 1;
+    auto lower = std::min(index, neighbour);
+    auto& into = shards_[lower]->keys;
+    auto& from = shards_[lower + 1]->keys;
+    if(into.size() + from.size() >= shard_capacity_ / 4){
+        return;
+    }
+    into.merge(from);
+    bounds_.erase(bounds_.begin() + lower);
+    shards_.erase(shards_.begin() + lower + 1);
+}
+
+#endif //STL_COMPATIBLE_SET_SHARDED_SET_HPP
@@ -0,0 +1,172 @@
+#ifndef STL_COMPATIBLE_SET_STATIC_SET_HPP
+#define STL_COMPATIBLE_SET_STATIC_SET_HPP
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+
+
+//  Set of at most N keys fixed at compile time. Construction sorts and
+//  deduplicates the keys in a constexpr context, so a constexpr static_set
+//  lives in read-only data and costs nothing at startup. Lookups run a
+//  branch-light binary search of exactly ceil(log2(size())) steps.
+//
+//      constexpr auto keywords = make_static_set<std::string_view>({"if", "else", "while"});
+//      static_assert(keywords.contains("else"));
+//
+//  Iterators are plain pointers into the sorted keys, with the member types
+//  and begin/end/rbegin/rend of set.
+template <class Key, size_t N, class Compare = std::less<Key>>
+class static_set {
+public:
+    using value_type = Key;
+    using key_compare = Compare;
+    using iterator = const Key*;
+    using const_iterator = const Key*;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+
+    constexpr explicit static_set(const Key (&keys)[N], const Compare& cmp = Compare());
+
+    constexpr iterator begin() const;
+    constexpr iterator end() const;
+    constexpr reverse_iterator rbegin() const;
+    constexpr reverse_iterator rend() const;
+
+    constexpr size_t size() const;
+    constexpr bool empty() const;
+    static constexpr size_t capacity();
+
+    constexpr iterator find(const Key& key) const;
+    constexpr iterator lower_bound(const Key& key) const;
+    constexpr iterator upper_bound(const Key& key) const;
+    constexpr bool contains(const Key& key) const;
+    constexpr size_t count(const Key& key) const;
+
+private:
+    Key keys_[N == 0 ? 1 : N] = {};
+    size_t size_ = 0;
+    Compare cmp_;
+};
+
+
+template <class Key, class Compare = std::less<Key>, size_t N>
+constexpr static_set<Key, N, Compare> make_static_set(const Key (&keys)[N], const Compare& cmp = Compare());
+
+
+//  ----------------------------------------
+//  |    STATIC SET METHODS DEFINITIONS    |
+//  ----------------------------------------
+
+
+template<class Key, size_t N, class Compare>
+constexpr static_set<Key, N, Compare>::static_set(const Key (&keys)[N], const Compare &cmp):
+    cmp_(cmp)
+{
+    //  insertion sort dropping duplicates: simple enough for constant
+    //  evaluation and fast on the short lists this is meant for
+    for(size_t i = 0; i < N; ++i){
+        size_t position = size_;
+        while(position > 0 && cmp_(keys[i], keys_[position - 1])){
+            --position;
+        }
+        if(position > 0 && !cmp_(keys_[position - 1], keys[i])){
+            continue;
+        }
+        for(size_t j = size_; j > position; --j){
+            keys_[j] = keys_[j - 1];
+        }
+        keys_[position] = keys[i];
+        ++size_;
+    }
+}
+
+template<class Key, size_t N, class Compare>
+constexpr typename static_set<Key, N, Compare>::iterator static_set<Key, N, Compare>::begin() const {
+    return keys_;
+}
+
+template<class Key, size_t N, class Compare>
+constexpr typename static_set<Key, N, Compare>::iterator static_set<Key, N, Compare>::end() const {
+    return keys_ + size_;
+}
+
+template<class Key, size_t N, class Compare>
+constexpr typename static_set<Key, N, Compare>::reverse_iterator static_set<Key, N, Compare>::rbegin() const {
+    return reverse_iterator(end());
+}
+
+template<class Key, size_t N, class Compare>
+constexpr typename static_set<Key, N, Compare>::reverse_iterator static_set<Key, N, Compare>::rend() const {
+    return reverse_iterator(begin());
+}
+
+template<class Key, size_t N, class Compare>
+constexpr size_t static_set<Key, N, Compare>::size() const {
+    return size_;
+}
+
+template<class Key, size_t N, class Compare>
+constexpr bool static_set<Key, N, Compare>::empty() const {
+    return size_ == 0;
+}
+
+template<class Key, size_t N, class Compare>
+constexpr size_t static_set<Key, N, Compare>::capacity() {
+    return N;
+}
+
+template<class Key, size_t N, class Compare>
+constexpr typename static_set<Key, N, Compare>::iterator static_set<Key, N, Compare>::find(const Key &key) const {
+    auto it = lower_bound(key);
+    return it != end() && !cmp_(key, *it) ? it : end();
+}
+
+template<class Key, size_t N, class Compare>
+constexpr typename static_set<Key, N, Compare>::iterator static_set<Key, N, Compare>::lower_bound(const Key &key) const {
+    //  halves the range without an early exit, so the step count depends on
+    //  the size alone and the compiler can turn the branch into a move
+    auto base = begin();
+    auto length = size_;
+    if(length == 0){
+        return base;
+    }
+    while(length > 1){
+        auto half = length / 2;
+        base = cmp_(base[half - 1], key) ? base + half : base;
+        length -= half;
+    }
+    return cmp_(*base, key) ? base + 1 : base;
+}
+
+template<class Key, size_t N, class Compare>
+constexpr typename static_set<Key, N, Compare>::iterator static_set<Key, N, Compare>::upper_bound(const Key &key) const {
+    auto base = begin();
+    auto length = size_;
+    if(length == 0){
+        return base;
+    }
+    while(length > 1){
+        auto half = length / 2;
+        base = cmp_(key, base[half - 1]) ? base : base + half;
+        length -= half;
+    }
+    return cmp_(key, *base) ? base : base + 1;
+}
+
+template<class Key, size_t N, class Compare>
+constexpr bool static_set<Key, N, Compare>::contains(const Key &key) const {
+    return find(key) != end();
+}
+
+template<class Key, size_t N, class Compare>
+constexpr size_t static_set<Key, N, Compare>::count(const Key &key) const {
+    return contains(key) ? 1 : 0;
+}
+
+
+template<class Key, class Compare, size_t N>
+constexpr static_set<Key, N, Compare> make_static_set(const Key (&keys)[N], const Compare &cmp) {
+    return static_set<Key, N, Compare>(keys, cmp);
+}
+
+#endif //STL_COMPATIBLE_SET_STATIC_SET_HPP
@@ -0,0 +1,293 @@
+#ifndef STL_COMPATIBLE_SET_THREAD_POOL_HPP
+#define STL_COMPATIBLE_SET_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+//  Fixed set of worker threads, each with its own task deque. A worker pops
+//  the newest task of its own deque and, once that is empty, steals the oldest
+//  one of another worker, so nested fork-join work stays local while idle
+//  workers take the large pieces. Tasks submitted from outside the pool are
+//  spread round-robin. A task must not throw, wrap it in a task_group to get
+//  exceptions back on the waiting thread.
+class thread_pool {
+public:
+    explicit thread_pool(size_t threads = default_size());
+    thread_pool(const thread_pool&) = delete;
+    ~thread_pool();
+
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    //  Process-wide pool with one worker per hardware thread.
+    static thread_pool& shared();
+    static size_t default_size();
+
+    size_t size() const;
+    void submit(std::function<void()> task);
+    //  Runs one queued task on the calling thread. Returns false if there
+    //  was nothing to run.
+    bool run_one();
+
+private:
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> next_queue_{0};
+    bool stop_ = false;
+
+    void work(size_t index);
+    bool pop(size_t home, std::function<void()>& task);
+    //  Pool and queue index of the calling thread, if it is a worker.
+    static std::pair<const thread_pool*, size_t>& current();
+};
+
+
+//  Fork-join helper on top of a thread_pool. wait() does not block: the
+//  waiting thread keeps running queued tasks, so groups can nest freely.
+class task_group {
+public:
+    explicit task_group(thread_pool& pool = thread_pool::shared());
+    task_group(const task_group&) = delete;
+    ~task_group();
+
+    task_group& operator=(const task_group&) = delete;
+
+    template <class Fn>
+    void run(Fn fn);
+    //  Returns once every task run so far has finished and rethrows the first
+    //  exception one of them threw.
+    void wait();
+
+private:
+    thread_pool& pool_;
+    std::atomic<size_t> pending_{0};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+
+    void drain();
+};
+
+
+//  Execution policy for the parallel set constructor and algorithms taking
+//  one: runs on the given pool, or on the shared one if there is none.
+struct parallel_policy {
+    thread_pool* pool = nullptr;
+
+    thread_pool& executor() const;
+};
+
+inline constexpr parallel_policy parallel_execution{};
+
+
+//  Merge sort whose halves are sorted as tasks of the pool down to runs of
+//  grain elements, which go to std::sort.
+template <class RandomIt, class Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare cmp, thread_pool& pool, size_t grain = 1 << 14);
+
+
+//  -----------------------------------------
+//  |      THREAD POOL DEFINITIONS          |
+//  -----------------------------------------
+
+
+inline thread_pool::thread_pool(size_t threads) {
+    threads = std::max<size_t>(threads, 1);
+    for(size_t i = 0; i < threads; ++i){
+        queues_.push_back(std::make_unique<worker_queue>());
+    }
+    for(size_t i = 0; i < threads; ++i){
+        threads_.emplace_back([this, i](){ work(i); });
+    }
+}
+
+inline thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for(auto& thread: threads_){
+        thread.join();
+    }
+}
+
+inline thread_pool &thread_pool::shared() {
+    static thread_pool pool;
+    return pool;
+}
+
+inline size_t thread_pool::default_size() {
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+inline size_t thread_pool::size() const {
+    return threads_.size();
+}
+
+inline void thread_pool::submit(std::function<void()> task) {
+    auto& self = current();
+    auto index = self.first == this ? self.second : next_queue_++ % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++queued_;
+    }
+    wake_.notify_one();
+}
+
+inline bool thread_pool::run_one() {
+    auto& self = current();
+    std::function<void()> task;
+    if(!pop(self.first == this ? self.second : 0, task)){
+        return false;
+    }
+    task();
+    return true;
+}
+
+inline void thread_pool::work(size_t index) {
+    current() = {this, index};
+    std::function<void()> task;
+    while(true){
+        if(pop(index, task)){
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait_for(lock, std::chrono::milliseconds(10), [this](){ return stop_ || queued_ > 0; });
+        if(stop_ && queued_ == 0){
+            return;
+        }
+    }
+}
+
+inline bool thread_pool::pop(size_t home, std::function<void()> &task) {
+    if(queued_ == 0){
+        return false;
+    }
+    for(size_t i = 0; i < queues_.size(); ++i){
+        auto& queue = *queues_[(home + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty()){
+            continue;
+        }
+        if(i == 0){
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        --queued_;
+        return true;
+    }
+    return false;
+}
+
+inline std::pair<const thread_pool*, size_t> &thread_pool::current() {
+    thread_local std::pair<const thread_pool*, size_t> self{nullptr, 0};
+    return self;
+}
+
+
+//  -----------------------------------------
+//  |      TASK GROUP DEFINITIONS           |
+//  -----------------------------------------
+
+
+inline task_group::task_group(thread_pool &pool):
+    pool_(pool)
+{}
+
+inline task_group::~task_group() {
+    drain();
+}
+
+template<class Fn>
+void task_group::run(Fn fn) {
+    ++pending_;
+    pool_.submit([this, fn = std::move(fn)]() mutable {
+        try {
+            fn();
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            if(!error_){
+                error_ = std::current_exception();
+            }
+        }
+        --pending_;
+    });
+}
+
+inline void task_group::wait() {
+    drain();
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        std::swap(error, error_);
+    }
+    if(error){
+        std::rethrow_exception(error);
+    }
+}
+
+inline void task_group::drain() {
+    while(pending_ > 0){
+        if(!pool_.run_one()){
+            std::this_thread::yield();
+        }
+    }
+}
+
+
+
+//  -----------------------------------------
+//  |    PARALLEL ALGORITHMS DEFINITIONS    |
+//  -----------------------------------------
+
+
+inline thread_pool &parallel_policy::executor() const {
+    return pool ? *pool : thread_pool::shared();
+}
+
+template<class RandomIt, class Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare cmp, thread_pool &pool, size_t grain) {
+    size_t count = last - first;
+    if(count <= std::max<size_t>(grain, 2)){
+        std::sort(first, last, cmp);
+        return;
+    }
+    auto middle = first + count / 2;
+    task_group group(pool);
+    group.run([=, &pool](){
+        parallel_sort(first, middle, cmp, pool, grain);
+    });
+    parallel_sort(middle, last, cmp, pool, grain);
+    group.wait();
+    std::inplace_merge(first, middle, last, cmp);
+}
+
+#endif //STL_COMPATIBLE_SET_THREAD_POOL_HPP
@@ -0,0 +1,407 @@
+#ifndef STL_COMPATIBLE_SET_TRACE_HPP
+#define STL_COMPATIBLE_SET_TRACE_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "key_codec.hpp"
+
+
+//  Operation traces of ordered sets, to replay production access patterns
+//  offline. recording_set wraps a set and logs every call to a compact binary
+//  file; read_trace loads it back and replay runs it against any set type
+//  with insert, erase, find, lower_bound and forward iterators, timing every
+//  operation into a latency histogram per kind.
+//
+//  File layout: the 8 byte magic "SETTRACE", then one record per operation:
+//  the op byte, for scans a varint with the number of keys visited, and the
+//  key as written by key_codec.
+
+
+enum class trace_op: uint8_t {
+    insert,
+    erase,
+    find,
+    lower_bound,
+    //  lower_bound followed by count increments
+    scan,
+};
+
+constexpr size_t trace_op_count = 5;
+
+const char* trace_op_name(trace_op op);
+
+
+template <class Key>
+struct trace_event {
+    trace_op op;
+    Key key;
+    uint32_t count = 0;
+};
+
+
+//  Latency histogram with log-linear buckets: 16 buckets per power of two of
+//  nanoseconds, so percentiles come out within about 6% of the exact value.
+class latency_histogram {
+public:
+    void record(uint64_t nanoseconds);
+    size_t count() const;
+    uint64_t total() const;
+    uint64_t max() const;
+    //  Smallest recorded latency not exceeded by the given fraction of
+    //  samples, e.g. 0.99 for p99, rounded up to its bucket.
+    uint64_t percentile(double fraction) const;
+    latency_histogram& operator+=(const latency_histogram& other);
+
+private:
+    static constexpr unsigned sub_bits = 4;
+    std::array<uint64_t, 64 << sub_bits> buckets_{};
+    size_t count_ = 0;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+
+    static size_t bucket(uint64_t value);
+    static uint64_t upper(size_t bucket);
+};
+
+
+template <class Key>
+class trace_writer {
+public:
+    explicit trace_writer(const std::string& path);
+    trace_writer(const trace_writer&) = delete;
+    ~trace_writer();
+
+    trace_writer& operator=(const trace_writer&) = delete;
+
+    void write(trace_op op, const Key& key, uint32_t count = 0);
+    void flush();
+
+private:
+    std::ofstream out_;
+    std::string buffer_;
+};
+
+
+template <class Key>
+std::vector<trace_event<Key>> read_trace(const std::string& path);
+
+
+//  Forwards to Set and records each call to a trace_writer. Only the calls
+//  made through it are recorded.
+template <class Set, class Key = typename std::iterator_traits<typename Set::iterator>::value_type>
+class recording_set {
+public:
+    using key_type = std::remove_const_t<Key>;
+
+    recording_set(Set& set, trace_writer<key_type>& writer);
+
+    void insert(const key_type& key);
+    void erase(const key_type& key);
+    typename Set::iterator find(const key_type& key);
+    typename Set::iterator lower_bound(const key_type& key);
+    //  Visits up to count keys starting at lower_bound(key).
+    template <class Fn>
+    size_t scan(const key_type& key, size_t count, Fn fn);
+
+private:
+    Set& set_;
+    trace_writer<key_type>& writer_;
+};
+
+
+struct replay_result {
+    std::array<latency_histogram, trace_op_count> latency;
+    double seconds = 0;
+    size_t operations = 0;
+    //  Mixes every lookup and scan result, equal for correct backends.
+    uint64_t checksum = 0;
+
+    double throughput() const;
+};
+
+
+//  Runs the trace against set, timing each operation separately.
+template <class Set, class Key>
+replay_result replay(const std::vector<trace_event<Key>>& trace, Set& set);
+
+
+//  -----------------------------------------
+//  |      LATENCY HISTOGRAM DEFINITIONS    |
+//  -----------------------------------------
+
+
+inline const char* trace_op_name(trace_op op) {
+    switch(op){
+        case trace_op::insert: return "insert";
+        case trace_op::erase: return "erase";
+        case trace_op::find: return "find";
+        case trace_op::lower_bound: return "lower_bound";
+        case trace_op::scan: return "scan";
+    }
+    return "unknown";
+}
+
+inline void latency_histogram::record(uint64_t nanoseconds) {
+    ++buckets_[bucket(nanoseconds)];
+    ++count_;
+    total_ += nanoseconds;
+    max_ = nanoseconds > max_ ? nanoseconds : max_;
+}
+
+inline size_t latency_histogram::count() const {
+    return count_;
+}
+
+inline uint64_t latency_histogram::total() const {
+    return total_;
+}
+
+inline uint64_t latency_histogram::max() const {
+    return max_;
+}
+
+inline uint64_t latency_histogram::percentile(double fraction) const {
+    if(count_ == 0){
+        return 0;
+    }
+    auto rank = static_cast<size_t>(fraction * count_);
+    rank = rank >= count_ ? count_ - 1 : rank;
+    size_t seen = 0;
+    for(size_t i = 0; i < buckets_.size(); ++i){
+        seen += buckets_[i];
+        if(seen > rank){
+            auto bound = upper(i);
+            return bound < max_ ? bound : max_;
+        }
+    }
+    return max_;
+}
+
+inline latency_histogram &latency_histogram::operator+=(const latency_histogram &other) {
+    for(size_t i = 0; i < buckets_.size(); ++i){
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    total_ += other.total_;
+    max_ = other.max_ > max_ ? other.max_ : max_;
+    return *this;
+}
+
+inline size_t latency_histogram::bucket(uint64_t value) {
+    //  values below 2^sub_bits get a bucket each, above that every power of
+    //  two is split into 2^sub_bits buckets by the bits after the top one
+    if(value < (uint64_t(1) << sub_bits)){
+        return value;
+    }
+    unsigned top = 63 - __builtin_clzll(value);
+    auto shift = top - sub_bits;
+    return ((shift + 1) << sub_bits) + ((value >> shift) & ((1u << sub_bits) - 1));
+}
+
+inline uint64_t latency_histogram::upper(size_t bucket) {
+    if(bucket < (size_t(1) << sub_bits)){
+        return bucket;
+    }
+    auto shift = (bucket >> sub_bits) - 1;
+    auto mantissa = (uint64_t(1) << sub_bits) + (bucket & ((1u << sub_bits) - 1));
+    return ((mantissa + 1) << shift) - 1;
+}
+
+
+inline double replay_result::throughput() const {
+    return seconds > 0 ? operations / seconds : 0;
+}
+
+
+//  -----------------------------------------
+//  |      TRACE FILE DEFINITIONS           |
+//  -----------------------------------------
+
+
+template<class Key>
+trace_writer<Key>::trace_writer(const std::string &path):
+    out_(path, std::ios::binary | std::ios::trunc)
+{
+    if(!out_){
+        throw std::runtime_error("trace_writer: cannot open " + path);
+    }
+    buffer_ = "SETTRACE";
+}
+
+template<class Key>
+trace_writer<Key>::~trace_writer() {
+    try {
+        flush();
+    } catch(...) {
+    }
+}
+
+template<class Key>
+void trace_writer<Key>::write(trace_op op, const Key &key, uint32_t count) {
+    buffer_.push_back(static_cast<char>(op));
+    if(op == trace_op::scan){
+        for(; count >= 0x80; count >>= 7){
+            buffer_.push_back(char(count | 0x80));
+        }
+        buffer_.push_back(char(count));
+    }
+    key_codec<Key>::encode(key, buffer_);
+    if(buffer_.size() >= (1 << 16)){
+        flush();
+    }
+}
+
+template<class Key>
+void trace_writer<Key>::flush() {
+    out_.write(buffer_.data(), buffer_.size());
+    out_.flush();
+    buffer_.clear();
+    if(!out_){
+        throw std::runtime_error("trace_writer: write failed");
+    }
+}
+
+template<class Key>
+std::vector<trace_event<Key>> read_trace(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if(!in || bytes.compare(0, 8, "SETTRACE") != 0){
+        throw std::runtime_error("read_trace: " + path + " is not a trace");
+    }
+    std::vector<trace_event<Key>> trace;
+    const char* first = bytes.data() + 8;
+    const char* last = bytes.data() + bytes.size();
+    while(first != last){
+        trace_event<Key> event{static_cast<trace_op>(*first++), Key(), 0};
+        if(static_cast<size_t>(event.op) >= trace_op_count){
+            throw std::runtime_error("read_trace: bad operation in " + path);
+        }
+        if(event.op == trace_op::scan){
+            //  a 32 bit count takes at most 5 bytes
+            for(unsigned shift = 0;; shift += 7){
+                if(shift > 28){
+                    throw std::runtime_error("read_trace: bad scan count in " + path);
+                }
+                if(first == last){
+                    throw std::runtime_error("read_trace: truncated " + path);
+                }
+                auto byte = static_cast<unsigned char>(*first++);
+                event.count |= uint32_t(byte & 0x7f) << shift;
+                if(byte < 0x80){
+                    break;
+                }
+            }
+        }
+        if(!key_codec<Key>::decode(first, last, event.key)){
+            throw std::runtime_error("read_trace: truncated " + path);
+        }
+        trace.push_back(std::move(event));
+    }
+    return trace;
+}
+
+
+//  -----------------------------------------
+//  |      RECORDING SET DEFINITIONS        |
+//  -----------------------------------------
+
+
+template<class Set, class Key>
+recording_set<Set, Key>::recording_set(Set &set, trace_writer<key_type> &writer):
+    set_(set), writer_(writer)
+{}
+
+template<class Set, class Key>
+void recording_set<Set, Key>::insert(const key_type &key) {
+    writer_.write(trace_op::insert, key);
+    set_.insert(key);
+}
+
+template<class Set, class Key>
+void recording_set<Set, Key>::erase(const key_type &key) {
+    writer_.write(trace_op::erase, key);
+    set_.erase(key);
+}
+
+template<class Set, class Key>
+typename Set::iterator recording_set<Set, Key>::find(const key_type &key) {
+    writer_.write(trace_op::find, key);
+    return set_.find(key);
+}
+
+template<class Set, class Key>
+typename Set::iterator recording_set<Set, Key>::lower_bound(const key_type &key) {
+    writer_.write(trace_op::lower_bound, key);
+    return set_.lower_bound(key);
+}
+
+template<class Set, class Key>
+template<class Fn>
+size_t recording_set<Set, Key>::scan(const key_type &key, size_t count, Fn fn) {
+    writer_.write(trace_op::scan, key, count);
+    size_t visited = 0;
+    for(auto it = set_.lower_bound(key), end = set_.end(); visited < count && it != end; ++it, ++visited){
+        fn(*it);
+    }
+    return visited;
+}
+
+
+//  -----------------------------------------
+//  |      REPLAY DEFINITIONS               |
+//  -----------------------------------------
+
+
+template<class Set, class Key>
+replay_result replay(const std::vector<trace_event<Key>> &trace, Set &set) {
+    using clock = std::chrono::steady_clock;
+    replay_result result;
+    auto mix = [&result](uint64_t value){
+        result.checksum = (result.checksum ^ value) * 0x100000001b3;
+    };
+    auto start = clock::now();
+    for(const auto& event: trace){
+        auto before = clock::now();
+        uint64_t outcome = 0;
+        switch(event.op){
+            case trace_op::insert:
+                set.insert(event.key);
+                break;
+            case trace_op::erase:
+                set.erase(event.key);
+                break;
+            case trace_op::find:
+                outcome = set.find(event.key) != set.end();
+                break;
+            case trace_op::lower_bound:
+                outcome = set.lower_bound(event.key) != set.end();
+                break;
+            case trace_op::scan: {
+                auto it = set.lower_bound(event.key);
+                auto end = set.end();
+                for(; outcome < event.count && it != end; ++it){
+                    ++outcome;
+                }
+                break;
+            }
+        }
+        auto after = clock::now();
+        result.latency[static_cast<size_t>(event.op)].record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count());
+        mix(outcome);
+    }
+    result.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    result.operations = trace.size();
+    return result;
+}
+
+#endif //STL_COMPATIBLE_SET_TRACE_HPP
@@ -1,67 +1,280 @@
 #ifndef SET_TREE_HPP
 #define SET_TREE_HPP
 
+#include <functional>
 #include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "balance.hpp"
+#include "key_prefix.hpp"
+#include "memory_usage.hpp"
+#include "thread_pool.hpp"
+
+
+//  Node orders for Tree::compact. in_order places nodes by key, which suits
+//  scans; van_emde_boas stores every subtree of about half the height
+//  contiguously, so a root-to-leaf search touches O(log_B n) cache lines for
+//  any line size B.
+enum class compact_order {
+    in_order,
+    van_emde_boas,
+};
 
-#define MAX_IMBALANCE (1)
 
-template <typename Key, typename Compare = std::less<Key>>
+template <typename Key, typename Compare = std::less<Key>, typename Balance = avl_balance,
+          typename Aggregate = no_aggregate>
 class Tree{
 public:
     Tree();
+    explicit Tree(const Balance& balance, const Aggregate& aggregate = Aggregate());
+    explicit Tree(const Compare& cmp, const Balance& balance = Balance(), const Aggregate& aggregate = Aggregate());
     Tree(const Tree& other);
     Tree(Tree&& other) noexcept ;
-    ~Tree()= default;
+    ~Tree();
 
+    //  Copy assignment reuses the nodes already owned by the tree, destroying
+    //  their keys and copy-constructing the new ones in place, and only
+    //  allocates or frees the difference in size.
     Tree& operator=(const Tree& other);
-
-    struct Node{
+    Tree& operator=(Tree&& other) noexcept;
+    void swap(Tree& other) noexcept;
+
+    //  Nodes are owned by the tree and linked with plain pointers. The height
+    //  (or rank, see balance.hpp) fits in one byte and goes after the key, so
+    //  for 4-byte keys it lands in the padding and a node takes 32 bytes.
+    //  The cached subtree aggregate and key prefix, if any, come first
+    //  (aggregate.hpp, key_prefix.hpp).
+    struct Node: aggregate_slot<typename Aggregate::value_type>, key_prefix_slot<Key, Compare>{
+        Node* left;
+        Node* right;
+        Node* parent;
         Key key;
-        std::weak_ptr<Node> parent;
-        std::shared_ptr<Node> left;
-        std::shared_ptr<Node> right;
-        size_t height;
+        unsigned char height;
 
-        explicit Node(const Key& key_, std::weak_ptr<Node> parent_ = std::weak_ptr<Node>(), size_t h = 1)
-        : key(key_), parent(parent_), height(h)
+        explicit Node(const Key& key_, Node* parent_ = nullptr, unsigned char h = 1)
+        : key_prefix_slot<Key, Compare>(key_), left(nullptr), right(nullptr), parent(parent_), key(key_), height(h)
         {}
-        explicit Node(std::weak_ptr<Node> parent_ = std::weak_ptr<Node>()):
-        parent(parent_){}
+    };
+
+    using node_ptr = Node*;
+    using aggregate_type = typename Aggregate::value_type;
+
+    //  In-order walk that keeps its own stack of pending ancestors instead of
+    //  climbing parent links, so each step is O(1) amortised and touches only
+    //  nodes it is about to hand out. Invalidated by any update of the tree.
+    class cursor {
+    public:
+        cursor() = default;
+        explicit cursor(const Tree& tree);
+        //  Starts at the first key not less than from.
+        cursor(const Tree& tree, const Key& from);
+
+        bool done() const;
+        //  Returns the current node and steps past it, null once done.
+        const Node* next();
+
+    private:
+        std::vector<const Node*> stack_;
+
+        void push_left(const Node* node);
     };
 
 
-    std::shared_ptr<Node> search(const Key& key) const;
-    std::shared_ptr<Node> insert(const Key& key);
-    std::shared_ptr<Node> erase(const Key& key);
-    std::shared_ptr<Node> lower_bound(const Key& key) const;
-    std::shared_ptr<Node> min_node() const;
-    std::shared_ptr<Node> max_node() const;
-    std::shared_ptr<Node> root() const;
+    Node* search(const Key& key) const;
+    //  Returns the node holding the key, whether it was just inserted or not.
+    Node* insert(const Key& key);
+    Node* erase(const Key& key);
+    Node* lower_bound(const Key& key) const;
+    Node* upper_bound(const Key& key) const;
+
+    //  Finger search: start from a node close to the key and climb only as
+    //  far as needed, which costs O(1) amortised for sorted probe sequences
+    //  and never more than twice a search from the root.
+    Node* search(const Node* hint, const Key& key) const;
+    Node* lower_bound(const Node* hint, const Key& key) const;
+    Node* min_node() const;
+    Node* max_node() const;
+    Node* root() const;
+    Node* next(const Node* node) const;
+    Node* prev(const Node* node) const;
+    //  Lowest node having both a and b in its subtree.
+    Node* common_ancestor(const Node* a, const Node* b) const;
 
     size_t size() const;
     bool empty() const;
+    void clear();
+    const Compare& key_comp() const;
+
+    memory_footprint memory_usage() const;
+
+    //  Calls visit(key) for every key of [lo, hi) in ascending order, skipping
+    //  subtrees that lie outside of the range. Stops once visit returns false.
+    template <class Visitor>
+    bool visit_range(const Key& lo, const Key& hi, Visitor&& visit) const;
+
+    //  Range erase: the tree is split at both ends of the range, the middle
+    //  part is freed as a whole and the outer parts are joined back, so the
+    //  cost is O(log n) plus the number of erased keys. All of them return
+    //  the number of erased keys. erase_from drops every key not less than lo.
+    size_t erase(const Key& lo, const Key& hi);
+    size_t erase_from(const Key& lo);
+    //  Erases every key the predicate holds for in one pass and relinks the
+    //  surviving nodes into a freshly balanced tree.
+    template <class Predicate>
+    size_t erase_if(Predicate pred);
+    //  Moves every key not less than key into upper, which is cleared first.
+    //  The tree is cut by one split in O(log n) and the nodes change owner
+    //  without being copied; only counting the moved nodes walks them.
+    void split_off(const Key& key, Tree& upper);
+
+    //  Node handles: extract unlinks the node holding key and hands it to
+    //  the caller, insert links a detached node back in. Neither allocates
+    //  nor copies the key, except that extract moves a node of the compacted
+    //  block to the heap (see compact). If the key is already present, insert returns
+    //  the node holding it and the detached node stays with the caller.
+    Node* extract(const Key& key);
+    Node* insert(Node* node);
+    //  Unlink the smallest or largest node like extract, starting from the
+    //  cached extreme instead of searching from the root, and rebalance
+    //  upward through parent links only while subtree heights change.
+    Node* extract_min();
+    Node* extract_max();
+
+    //  Moves every node into one contiguous block in the given order, keeping
+    //  the shape of the tree, in O(n) plus one allocation. Invalidates all
+    //  node pointers. Slots of the block freed by later erases are reused by
+    //  inserts; the block is released with its last node. Nodes handed out
+    //  by extract, extract_min, extract_max and extract_if are always moved
+    //  out of the block first, so the caller may delete them.
+    void compact(compact_order order = compact_order::in_order);
+
+    //  Combination of the keys of the whole tree or of [lo, hi) in key
+    //  order, in O(log n). Only for trees with an aggregate policy.
+    aggregate_type aggregate() const;
+    aggregate_type aggregate(const Key& lo, const Key& hi) const;
+    const Aggregate& aggregate_policy() const;
+
+    //  Fork-join traversals: subtrees above a height cut-off are split into
+    //  their left subtree, run as a task on the pool, and the rest, handled by
+    //  the calling thread. fn is called concurrently and in no fixed order,
+    //  while the reduction combines partial results in key order, so combine
+    //  only has to be associative and identity neutral for it.
+    template <class Fn>
+    void parallel_for_each(Fn& fn, thread_pool& pool) const;
+    template <class T, class Combine, class Transform>
+    T parallel_transform_reduce(T identity, Combine& combine, Transform& transform, thread_pool& pool) const;
+    //  Replaces the content with the sorted unique keys [first, last) in
+    //  O(n), building large subtrees as separate tasks. Every task allocates
+    //  the nodes of its own subtree.
+    void assign_sorted(const Key* first, const Key* last, thread_pool& pool);
+    //  Like erase_if, but passes the unlinked nodes to sink instead of
+    //  freeing them.
+    template <class Predicate, class Sink>
+    size_t extract_if(Predicate pred, Sink sink);
+    //  Batch update from two disjoint runs of sorted unique keys: inserts the
+    //  keys of [add, add_last) not present yet and erases those of [drop,
+    //  drop_last). A batch large against the tree is merged with its in-order
+    //  node sequence and relinked by build in O(n + m), reusing the nodes that
+    //  stay; a small one is applied key by key.
+    void merge_sorted(const Key* add, const Key* add_last, const Key* drop, const Key* drop_last);
 
 private:
-    std::shared_ptr<Node> root_;
-    std::shared_ptr<Node> min_node_;
-    std::shared_ptr<Node> max_node_;
+    Node* root_;
+    Node* min_node_;
+    Node* max_node_;
     size_t size_;
     Compare cmp_;
-
-    std::shared_ptr<Node> insert(std::shared_ptr<Node>& node, const Key& key);
-    std::shared_ptr<Node> erase(std::shared_ptr<Node>& node, const Key& key);
-    std::shared_ptr<Node> erase_min(std::shared_ptr<Node>& node);
-    std::shared_ptr<Node> find_min(std::shared_ptr<Node>& node);
-    std::shared_ptr<Node> find_max(std::shared_ptr<Node>& node);
-    std::shared_ptr<Node> balance(std::shared_ptr<Node>& node);
-    std::shared_ptr<Node> right_rotate(std::shared_ptr<Node>& node);
-    std::shared_ptr<Node> left_rotate(std::shared_ptr<Node>& node);
-
-    int8_t balance_factor(std::shared_ptr<Node>& node);
-    size_t height(std::shared_ptr<Node>& node);
-    void fix_height(std::shared_ptr<Node>& node);
-
-    std::shared_ptr<Node> copy_tree(std::shared_ptr<Node> other, std::shared_ptr<Node> parent = nullptr);
+    Balance balance_;
+    Aggregate aggregate_;
+    //  Block laid out by compact and its unused slots. Every slot is either
+    //  a node of this tree or in arena_free_.
+    Node* arena_ = nullptr;
+    size_t arena_capacity_ = 0;
+    std::vector<Node*> arena_free_;
+
+    Node* insert(Node* node, const Key& key, Node*& found, Node* detached = nullptr);
+    Node* erase(Node* node, const Key& key, Node*& removed);
+    Node* erase_min(Node* node);
+    //  extract and extract_if without moving nodes out of the compacted block.
+    Node* unlink(const Key& key);
+    template <class Predicate, class Sink>
+    size_t unlink_if(Predicate pred, Sink sink);
+    //  Rebalances from node up to the root, stopping once a subtree keeps its
+    //  root and height; aggregates above are still refreshed.
+    void rebalance_up(Node* node);
+    Node* find_min(Node* node) const;
+    Node* find_max(Node* node) const;
+    Node* balance(Node* node);
+    Node* right_rotate(Node* node);
+    Node* left_rotate(Node* node);
+
+    int8_t balance_factor(Node* node) const;
+    size_t height(Node* node) const;
+    void fix_height(Node* node);
+    //  Recomputes the cached aggregate of node from its children.
+    void update(Node* node);
+    aggregate_type aggregate(const Node* node, const Key* lo, const Key* hi) const;
+
+    //  Nodes come from the free slots of the compacted block before new;
+    //  that path only runs single-threaded, parallel builds start from an
+    //  empty tree which has no block.
+    Node* create_node(const Key& key, Node* parent = nullptr, unsigned char h = 1);
+    void destroy_node(Node* node);
+    bool in_arena(const Node* node) const;
+    //  Returns node itself, or a heap copy if it lives in the block.
+    Node* detach(Node* node);
+    //  veb_order appends the top levels of the subtree of node in van Emde
+    //  Boas order, collect_level the nodes exactly levels below node from
+    //  left to right.
+    void veb_order(Node* node, size_t levels, std::vector<Node*>& out) const;
+    void collect_level(Node* node, size_t levels, std::vector<Node*>& out) const;
+    size_t count_levels(const Node* node) const;
+    //  Copies a subtree, taking nodes from the spare list (linked through
+    //  left) before allocating new ones.
+    Node* copy_tree(const Node* other, Node* parent, Node*& spare);
+    size_t destroy_tree(Node* node);
+    //  Counts a subtree cut off for another tree, moving the nodes that live
+    //  in the compacted block to the heap.
+    size_t hand_over(Node*& node, Node* parent);
+    //  Unlinks a subtree into the spare list without freeing anything.
+    void recycle(Node* node, Node*& spare);
+    void destroy_list(Node* spare);
+
+    template <class Visitor>
+    bool visit_range(const Node* node, const Key& lo, const Key& hi, Visitor& visit) const;
+
+    Node* lower_bound(Node* node, Node* bound, const Key& key) const;
+
+    //  key < node->key and node->key < key, answered from the cached prefixes
+    //  when they decide it; probe caches the prefix of key.
+    using probe = key_prefix_slot<Key, Compare>;
+    bool key_less(const Key& key, const probe& prefix, const Node* node) const;
+    bool node_less(const Node* node, const Key& key, const probe& prefix) const;
+
+    size_t parallel_cutoff(const thread_pool& pool) const;
+    template <class Fn>
+    void for_each(const Node* node, Fn& fn, size_t cutoff, thread_pool& pool) const;
+    template <class T, class Combine, class Transform>
+    T transform_reduce(const Node* node, const T& identity, Combine& combine, Transform& transform,
+                       size_t cutoff, thread_pool& pool) const;
+
+    size_t erase_range(const Key* lo, const Key* hi);
+    //  Splits a standalone subtree into the keys less than key and the rest.
+    std::pair<Node*, Node*> split(Node* node, const Key& key);
+    //  Joins two standalone subtrees with every key of left less than pivot
+    //  and every key of right greater than it.
+    Node* join(Node* left, Node* pivot, Node* right);
+    Node* join(Node* left, Node* right);
+    //  Links nodes[first, last), sorted by key, into a balanced subtree.
+    Node* build(const std::vector<Node*>& nodes, size_t first, size_t last, Node* parent);
+    Node* build(const Key* keys, size_t count, Node* parent, size_t grain, thread_pool& pool);
+
+    friend balance_base;
 
 };
 
@@ -71,54 +284,125 @@ private:
 //  -------------------------------------
 
 
-template<typename Key, typename Compare>
-Tree<Key, Compare>::Tree()
-: root_(nullptr), size_(0), cmp_(Compare())
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>::Tree()
+: root_(nullptr), min_node_(nullptr), max_node_(nullptr), size_(0), cmp_(Compare())
+{}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>::Tree(const Balance &balance, const Aggregate &aggregate)
+: root_(nullptr), min_node_(nullptr), max_node_(nullptr), size_(0), cmp_(Compare()), balance_(balance),
+  aggregate_(aggregate)
+{}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>::Tree(const Compare &cmp, const Balance &balance, const Aggregate &aggregate)
+: root_(nullptr), min_node_(nullptr), max_node_(nullptr), size_(0), cmp_(cmp), balance_(balance),
+  aggregate_(aggregate)
 {}
 
-template<typename Key, typename Compare>
-Tree<Key, Compare>::Tree(const Tree &other):size_(other.size_), cmp_(other.cmp_) {
-    root_ = copy_tree(other.root_);
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>::Tree(const Tree &other):size_(other.size_), cmp_(other.cmp_), balance_(other.balance_),
+    aggregate_(other.aggregate_)
+{
+    Node* spare = nullptr;
+    root_ = copy_tree(other.root_, nullptr, spare);
     min_node_ = find_min(root_);
     max_node_ = find_max(root_);
 }
 
-template<typename Key, typename Compare>
-Tree<Key, Compare>::Tree(Tree &&other) noexcept:
-        root_(std::move(other.root_)), min_node_(std::move(other.min_node_)),
-        max_node_(std::move(other.max_node_)), size_(other.size_), cmp_(std::move(other.cmp_))
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>::Tree(Tree &&other) noexcept:
+        root_(other.root_), min_node_(other.min_node_),
+        max_node_(other.max_node_), size_(other.size_), cmp_(std::move(other.cmp_)),
+        balance_(std::move(other.balance_)), aggregate_(std::move(other.aggregate_))
 {
+    other.root_ = nullptr;
+    other.min_node_ = nullptr;
+    other.max_node_ = nullptr;
     other.size_ = 0;
+    std::swap(arena_, other.arena_);
+    std::swap(arena_capacity_, other.arena_capacity_);
+    arena_free_.swap(other.arena_free_);
 }
 
-template<typename Key, typename Compare>
-Tree<Key, Compare>&Tree<Key, Compare>::operator=(const Tree &other) {
-    root_ = copy_tree(other.root_);
-    size_ = other.size_;
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>::~Tree() {
+    destroy_tree(root_);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>&Tree<Key, Compare, Balance, Aggregate>::operator=(const Tree &other) {
+    if(this == &other){
+        return *this;
+    }
+    Node* spare = nullptr;
+    recycle(root_, spare);
+    root_ = nullptr;
+    min_node_ = nullptr;
+    max_node_ = nullptr;
+    size_ = 0;
     cmp_ = other.cmp_;
+    balance_ = other.balance_;
+    aggregate_ = other.aggregate_;
+    try {
+        root_ = copy_tree(other.root_, nullptr, spare);
+    } catch(...) {
+        destroy_list(spare);
+        throw;
+    }
+    destroy_list(spare);
+    size_ = other.size_;
     min_node_ = find_min(root_);
     max_node_ = find_max(root_);
     return *this;
 }
 
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node>Tree<Key, Compare>::insert(const Key &key) {
-    root_ = insert(root_, key);
-    return root_;
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>&Tree<Key, Compare, Balance, Aggregate>::operator=(Tree &&other) noexcept {
+    if(this != &other){
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::swap(Tree &other) noexcept {
+    std::swap(root_, other.root_);
+    std::swap(min_node_, other.min_node_);
+    std::swap(max_node_, other.max_node_);
+    std::swap(size_, other.size_);
+    std::swap(cmp_, other.cmp_);
+    std::swap(balance_, other.balance_);
+    std::swap(aggregate_, other.aggregate_);
+    std::swap(arena_, other.arena_);
+    std::swap(arena_capacity_, other.arena_capacity_);
+    arena_free_.swap(other.arena_free_);
+}
+
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::insert(const Key &key) {
+    Node* found = nullptr;
+    root_ = insert(root_, key, found);
+    root_->parent = nullptr;
+    return found;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::search(const Key &key) const {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::search(const Key &key) const {
     if(!root_){
         return nullptr;
     }
 
+    probe prefix(key);
     auto current = root_;
     while (current){
-        if(cmp_(key, current->key)){
+        if(key_less(key, prefix, current)){
             current = current->left;
-        } else if (cmp_(current->key, key)){
+        } else if (node_less(current, key, prefix)){
             current = current->right;
         } else {
             return current;
@@ -127,24 +411,168 @@ std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::search(co
     return nullptr;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::erase(const Key &key) {
-    root_ = erase(root_, key);
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::erase(const Key &key) {
+    auto node = unlink(key);
+    if(node){
+        destroy_node(node);
+    }
     return root_;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::lower_bound(const Key &key) const {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::extract(const Key &key) {
+    return detach(unlink(key));
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::unlink(const Key &key) {
+    Node* removed = nullptr;
+    root_ = erase(root_, key, removed);
+    if(root_){
+        root_->parent = nullptr;
+    }
+    if(removed){
+        removed->left = removed->right = removed->parent = nullptr;
+    }
+    return removed;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::insert(Node *node) {
+    node->left = node->right = node->parent = nullptr;
+    node->height = 1;
+    Node* found = nullptr;
+    node->cache(node->key);
+    root_ = insert(root_, node->key, found, node);
+    root_->parent = nullptr;
+    return found;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::extract_min() {
+    auto node = min_node_;
+    if(!node){
+        return nullptr;
+    }
+    //  the minimum has no left child, its right subtree takes its place
+    auto parent = node->parent;
+    auto child = node->right;
+    if(child){
+        child->parent = parent;
+    }
+    if(parent){
+        parent->left = child;
+    } else {
+        root_ = child;
+    }
+    min_node_ = child ? find_min(child) : parent;
+    if(!root_){
+        max_node_ = nullptr;
+    }
+    --size_;
+    rebalance_up(parent);
+    node->left = node->right = node->parent = nullptr;
+    return detach(node);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::extract_max() {
+    auto node = max_node_;
+    if(!node){
+        return nullptr;
+    }
+    auto parent = node->parent;
+    auto child = node->left;
+    if(child){
+        child->parent = parent;
+    }
+    if(parent){
+        parent->right = child;
+    } else {
+        root_ = child;
+    }
+    max_node_ = child ? find_max(child) : parent;
+    if(!root_){
+        min_node_ = nullptr;
+    }
+    --size_;
+    rebalance_up(parent);
+    node->left = node->right = node->parent = nullptr;
+    return detach(node);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::compact(compact_order order) {
+    if(!root_){
+        return;
+    }
+    std::vector<Node*> nodes;
+    nodes.reserve(size_);
+    if(order == compact_order::in_order){
+        for(auto node = min_node_; node; node = next(node)){
+            nodes.push_back(node);
+        }
+    } else {
+        veb_order(root_, count_levels(root_), nodes);
+    }
+
+    //  the old nodes stay intact until every copy is made, keys are only
+    //  moved when that cannot throw
+    std::allocator<Node> allocator;
+    auto block = allocator.allocate(nodes.size());
+    size_t built = 0;
+    try {
+        for(; built < nodes.size(); ++built){
+            new (block + built) Node(std::move_if_noexcept(*nodes[built]));
+        }
+    } catch(...) {
+        while(built){
+            block[--built].~Node();
+        }
+        allocator.deallocate(block, nodes.size());
+        throw;
+    }
+
+    //  the old parent links now forward to the copies
+    for(size_t i = 0; i < nodes.size(); ++i){
+        nodes[i]->parent = block + i;
+    }
+    auto moved = [](Node* node){
+        return node ? node->parent : nullptr;
+    };
+    for(size_t i = 0; i < nodes.size(); ++i){
+        auto& copy = block[i];
+        copy.left = moved(copy.left);
+        copy.right = moved(copy.right);
+        copy.parent = moved(copy.parent);
+    }
+    root_ = moved(root_);
+    min_node_ = moved(min_node_);
+    max_node_ = moved(max_node_);
+
+    //  frees the previous block as well, all of its nodes are in the tree
+    for(auto node: nodes){
+        destroy_node(node);
+    }
+    arena_ = block;
+    arena_capacity_ = nodes.size();
+    arena_free_.clear();
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::lower_bound(const Key &key) const {
+    probe prefix(key);
     auto node = root_;
-    std::shared_ptr<typename Tree<Key, Compare>::Node> prev_lb = nullptr;
+    Node* prev_lb = nullptr;
 
     while(node){
-        if( !cmp_(node->key, key)){
+        if(!node_less(node, key, prefix)){
             prev_lb = node;
             node = node->left;
         } else {
             node = node->right;
-            if(node && !cmp_(node->key, key)){
+            if(node && !node_less(node, key, prefix)){
                 prev_lb = node;
             }
         }
@@ -152,41 +580,380 @@ std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::lower_bou
     return prev_lb;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::min_node() const {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::upper_bound(const Key &key) const {
+    probe prefix(key);
+    auto node = root_;
+    Node* prev_ub = nullptr;
+
+    while(node){
+        if(key_less(key, prefix, node)){
+            prev_ub = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return prev_ub;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::search(const Node *hint, const Key &key) const {
+    auto node = lower_bound(hint, key);
+    if(node && !cmp_(key, node->key)){
+        return node;
+    }
+    return nullptr;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::lower_bound(const Node *hint, const Key &key) const {
+    if(!hint){
+        return lower_bound(key);
+    }
+    auto node = const_cast<Node*>(hint);
+    bool forward = !cmp_(key, node->key);
+    if(forward && !cmp_(node->key, key)){
+        return node;
+    }
+
+    //  Climb until the subtree of node is known to hold the answer: going
+    //  forward that is the first ancestor reached from its left side that is
+    //  not less than the key, going backward the first one reached from its
+    //  right side that is less than the key.
+    Node* bound = nullptr;
+    while(node->parent){
+        auto parent = node->parent;
+        if(forward && parent->left == node && !cmp_(parent->key, key)){
+            bound = parent;
+            break;
+        }
+        if(!forward && parent->right == node && cmp_(parent->key, key)){
+            break;
+        }
+        node = parent;
+    }
+    return lower_bound(node, bound, key);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::min_node() const {
     return min_node_;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::max_node() const {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::max_node() const {
     return max_node_;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::root() const {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::root() const {
     return root_;
 }
 
-template<typename Key, typename Compare>
-size_t Tree<Key, Compare>::size() const {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::next(const Node *node) const {
+    if(node->right){
+        return find_min(node->right);
+    }
+    while(node->parent && node->parent->right == node){
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::prev(const Node *node) const {
+    if(node->left){
+        return find_max(node->left);
+    }
+    while(node->parent && node->parent->left == node){
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::common_ancestor(const Node *a, const Node *b) const {
+    auto depth = [](const Node* node){
+        size_t result = 0;
+        for(; node->parent; node = node->parent){
+            ++result;
+        }
+        return result;
+    };
+    auto depth_a = depth(a);
+    auto depth_b = depth(b);
+    for(; depth_a > depth_b; --depth_a){
+        a = a->parent;
+    }
+    for(; depth_b > depth_a; --depth_b){
+        b = b->parent;
+    }
+    while(a != b){
+        a = a->parent;
+        b = b->parent;
+    }
+    return const_cast<Node*>(a);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::size() const {
     return size_;
 }
 
-template<typename Key, typename Compare>
-bool Tree<Key, Compare>::empty() const {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+bool Tree<Key, Compare, Balance, Aggregate>::empty() const {
     return size_ == 0;
 }
 
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::clear() {
+    destroy_tree(root_);
+    root_ = nullptr;
+    min_node_ = nullptr;
+    max_node_ = nullptr;
+    size_ = 0;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+const Compare &Tree<Key, Compare, Balance, Aggregate>::key_comp() const {
+    return cmp_;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+memory_footprint Tree<Key, Compare, Balance, Aggregate>::memory_usage() const {
+    memory_footprint usage;
+    usage.object_bytes = sizeof(*this);
+    if(!root_){
+        return usage;
+    }
+
+    std::vector<const Node*> stack{root_};
+    while(!stack.empty()){
+        auto node = stack.back();
+        stack.pop_back();
+        usage.key_bytes += key_memory<Key>::out_of_line(node->key);
+        if(node->left){
+            stack.push_back(node->left);
+        }
+        if(node->right){
+            stack.push_back(node->right);
+        }
+    }
+    //  nodes of the compacted block share one allocation, its free slots are
+    //  held without holding a node
+    auto in_block = arena_capacity_ - arena_free_.size();
+    usage.nodes = size_;
+    usage.node_bytes = size_ * sizeof(Node);
+    usage.overhead_bytes = (size_ - in_block) * allocation_overhead(sizeof(Node));
+    if(arena_){
+        usage.overhead_bytes += arena_free_.size() * sizeof(Node) + allocation_overhead(arena_capacity_ * sizeof(Node))
+                              + arena_free_.capacity() * sizeof(Node*);
+    }
+    return usage;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class Visitor>
+bool Tree<Key, Compare, Balance, Aggregate>::visit_range(const Key &lo, const Key &hi, Visitor &&visit) const {
+    return visit_range(root_, lo, hi, visit);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::aggregate_type Tree<Key, Compare, Balance, Aggregate>::aggregate() const {
+    return aggregate(root_, nullptr, nullptr);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::aggregate_type Tree<Key, Compare, Balance, Aggregate>::aggregate(const Key &lo, const Key &hi) const {
+    if(!cmp_(lo, hi)){
+        return aggregate_.identity();
+    }
+    return aggregate(root_, &lo, &hi);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+const Aggregate &Tree<Key, Compare, Balance, Aggregate>::aggregate_policy() const {
+    return aggregate_;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class Fn>
+void Tree<Key, Compare, Balance, Aggregate>::parallel_for_each(Fn &fn, thread_pool &pool) const {
+    for_each(root_, fn, parallel_cutoff(pool), pool);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class T, class Combine, class Transform>
+T Tree<Key, Compare, Balance, Aggregate>::parallel_transform_reduce(T identity, Combine &combine, Transform &transform, thread_pool &pool) const {
+    return transform_reduce(root_, identity, combine, transform, parallel_cutoff(pool), pool);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::assign_sorted(const Key *first, const Key *last, thread_pool &pool) {
+    clear();
+    size_t count = last - first;
+    root_ = build(first, count, nullptr, std::max<size_t>(count / (8 * pool.size()), 1024), pool);
+    size_ = count;
+    min_node_ = find_min(root_);
+    max_node_ = find_max(root_);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::erase(const Key &lo, const Key &hi) {
+    if(!cmp_(lo, hi)){
+        return 0;
+    }
+    return erase_range(&lo, &hi);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::erase_from(const Key &lo) {
+    return erase_range(&lo, nullptr);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class Predicate>
+size_t Tree<Key, Compare, Balance, Aggregate>::erase_if(Predicate pred) {
+    return unlink_if(pred, [this](Node* node){
+        destroy_node(node);
+    });
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::split_off(const Key &key, Tree &upper) {
+    if(&upper == this){
+        return;
+    }
+    upper.clear();
+    Node* rest;
+    std::tie(root_, rest) = split(root_, key);
+    if(root_){
+        root_->parent = nullptr;
+    }
+    auto moved = hand_over(rest, nullptr);
+    size_ -= moved;
+    min_node_ = find_min(root_);
+    max_node_ = find_max(root_);
+    upper.root_ = rest;
+    upper.size_ = moved;
+    upper.min_node_ = upper.find_min(rest);
+    upper.max_node_ = upper.find_max(rest);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class Predicate, class Sink>
+size_t Tree<Key, Compare, Balance, Aggregate>::extract_if(Predicate pred, Sink sink) {
+    return unlink_if(pred, [this, &sink](Node* node){
+        sink(detach(node));
+    });
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class Predicate, class Sink>
+size_t Tree<Key, Compare, Balance, Aggregate>::unlink_if(Predicate pred, Sink sink) {
+    std::vector<Node*> nodes;
+    nodes.reserve(size_);
+    for(auto node = min_node_; node; node = next(node)){
+        nodes.push_back(node);
+    }
+
+    size_t kept = 0;
+    for(auto node: nodes){
+        if(pred(static_cast<const Key&>(node->key))){
+            sink(node);
+        } else {
+            nodes[kept++] = node;
+        }
+    }
+    auto erased = size_ - kept;
+    if(!erased){
+        return 0;
+    }
+    root_ = build(nodes, 0, kept, nullptr);
+    size_ = kept;
+    min_node_ = kept ? nodes.front() : nullptr;
+    max_node_ = kept ? nodes[kept - 1] : nullptr;
+    return erased;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::merge_sorted(const Key *add, const Key *add_last, const Key *drop, const Key *drop_last) {
+    size_t count = (add_last - add) + (drop_last - drop);
+    size_t depth = 1;
+    for(auto n = size_; n > 1; n >>= 1){
+        ++depth;
+    }
+    if(count * depth < size_){
+        for(; drop != drop_last; ++drop){
+            erase(*drop);
+        }
+        for(; add != add_last; ++add){
+            insert(*add);
+        }
+        return;
+    }
+
+    std::vector<Node*> nodes;
+    nodes.reserve(size_);
+    for(auto node = min_node_; node; node = next(node)){
+        nodes.push_back(node);
+    }
+    //  new nodes are allocated before anything is unlinked, so a throwing
+    //  allocation or copy leaves the tree as it was
+    std::vector<Node*> merged;
+    merged.reserve(nodes.size() + (add_last - add));
+    std::vector<Node*> dropped;
+    dropped.reserve(drop_last - drop);
+    try {
+        for(auto node: nodes){
+            for(; add != add_last && cmp_(*add, node->key); ++add){
+                merged.push_back(create_node(*add));
+            }
+            if(add != add_last && !cmp_(node->key, *add)){
+                ++add;
+            }
+            for(; drop != drop_last && cmp_(*drop, node->key); ++drop){}
+            if(drop != drop_last && !cmp_(node->key, *drop)){
+                dropped.push_back(node);
+            } else {
+                merged.push_back(node);
+            }
+        }
+        for(; add != add_last; ++add){
+            merged.push_back(create_node(*add));
+        }
+    } catch(...) {
+        //  the created nodes are the only ones without a parent besides the root
+        for(auto node: merged){
+            if(!node->parent && node != root_){
+                destroy_node(node);
+            }
+        }
+        throw;
+    }
+    for(auto node: dropped){
+        destroy_node(node);
+    }
+    root_ = build(merged, 0, merged.size(), nullptr);
+    size_ = merged.size();
+    min_node_ = size_ ? merged.front() : nullptr;
+    max_node_ = size_ ? merged.back() : nullptr;
+}
+
 
 //  --------------------------------------
 //  |       INTERNAL TREE METHODS        |
 //  --------------------------------------
 
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key,Compare>::Node> Tree<Key, Compare>::insert(std::shared_ptr<Node> &node, const Key &key) {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::insert(Node* node, const Key &key, Node*& found, Node* detached) {
     if(!node){
-        node = std::make_shared<Node>(key);
+        node = detached ? detached : create_node(key);
+        update(node);
+        found = node;
         ++size_;
         if(!min_node_ || cmp_(key, min_node_->key)){
             min_node_ = node;
@@ -198,45 +965,55 @@ std::shared_ptr<typename Tree<Key,Compare>::Node> Tree<Key, Compare>::insert(std
     }
 
     if(cmp_(key, node->key)){
-        node->left = insert(node->left, key);
+        node->left = insert(node->left, key, found, detached);
         node->left->parent = node;
     } else if (cmp_(node->key, key)){
-        node->right = insert(node->right, key);
+        node->right = insert(node->right, key, found, detached);
         node->right->parent = node;
+    } else {
+        found = node;
+        return node;
     }
 
     return balance(node);
 }
 
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::erase(std::shared_ptr<Node>& node, const  Key &key) {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::erase(Node* node, const  Key &key, Node*& removed) {
     if(!node){
         return nullptr;
     }
     if(cmp_(key, node->key)){
-        node->left = erase(node->left, key);
+        node->left = erase(node->left, key, removed);
+        if(node->left){
+            node->left->parent = node;
+        }
     } else if (cmp_(node->key, key)){
-        node->right = erase(node->right, key);
+        node->right = erase(node->right, key, removed);
+        if(node->right){
+            node->right->parent = node;
+        }
     } else {
         --size_;
 
         if(!node->right){
             if(node == min_node_){
-                min_node_ = node->parent.lock();
+                min_node_ = node->parent;
             }
             if(node == max_node_){
                 if(!node->left){
-                    max_node_ = node->parent.lock();
+                    max_node_ = node->parent;
                 } else {
                     max_node_ = find_max(node->left);
                 }
             }
 
             auto left = node->left;
-            node->parent.reset();
-            node->right.reset();
-            node->left.reset();
+            if(left){
+                left->parent = node->parent;
+            }
+            removed = node;
             return left;
         }
         auto min = find_min(node->right);
@@ -246,27 +1023,299 @@ std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::erase(std
         }
 
         min->right = erase_min(node->right);
+        if(min->right){
+            min->right->parent = min;
+        }
         min->left = node->left;
         if(min->left){
             min->left->parent = min;
         }
         min->parent = node->parent;
+        min->height = node->height;
+        removed = node;
         return balance(min);
     }
     return balance(node);
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::erase_min(std::shared_ptr<Node>& node){
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::erase_min(Node* node){
     if(!node->left){
         return node->right;
     }
     node->left = erase_min(node->left);
+    if(node->left){
+        node->left->parent = node;
+    }
     return balance(node);
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::find_min(std::shared_ptr<Node>& node){
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::rebalance_up(Node *node) {
+    while(node){
+        auto parent = node->parent;
+        auto height = node->height;
+        auto root = balance(node);
+        if(!parent){
+            root_ = root;
+        } else if(parent->left == node){
+            parent->left = root;
+        } else {
+            parent->right = root;
+        }
+        if(root == node && root->height == height){
+            //  every policy only acts on the heights next to a node, so the
+            //  ancestors are balanced already
+            if constexpr (!std::is_void<aggregate_type>::value){
+                for(; parent; parent = parent->parent){
+                    update(parent);
+                }
+            }
+            return;
+        }
+        node = parent;
+    }
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::parallel_cutoff(const thread_pool &pool) const {
+    //  aim at about eight tasks per worker and never fewer than ~256 keys each
+    size_t cutoff = 8;
+    while(cutoff < 64 && (size_t(1) << cutoff) < size_ / (8 * pool.size())){
+        ++cutoff;
+    }
+    return cutoff;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class Fn>
+void Tree<Key, Compare, Balance, Aggregate>::for_each(const Node *node, Fn &fn, size_t cutoff, thread_pool &pool) const {
+    if(!node){
+        return;
+    }
+    if(node->height <= cutoff){
+        for_each(node->left, fn, cutoff, pool);
+        fn(static_cast<const Key&>(node->key));
+        for_each(node->right, fn, cutoff, pool);
+        return;
+    }
+    task_group group(pool);
+    group.run([this, node, &fn, cutoff, &pool](){
+        for_each(node->left, fn, cutoff, pool);
+    });
+    fn(static_cast<const Key&>(node->key));
+    for_each(node->right, fn, cutoff, pool);
+    group.wait();
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class T, class Combine, class Transform>
+T Tree<Key, Compare, Balance, Aggregate>::transform_reduce(const Node *node, const T &identity, Combine &combine, Transform &transform,
+                                                           size_t cutoff, thread_pool &pool) const {
+    if(!node){
+        return identity;
+    }
+    if(node->height <= cutoff){
+        auto left = transform_reduce(node->left, identity, combine, transform, cutoff, pool);
+        auto middle = combine(std::move(left), transform(static_cast<const Key&>(node->key)));
+        return combine(std::move(middle), transform_reduce(node->right, identity, combine, transform, cutoff, pool));
+    }
+    task_group group(pool);
+    T left = identity;
+    group.run([&](){
+        left = transform_reduce(node->left, identity, combine, transform, cutoff, pool);
+    });
+    auto right = transform_reduce(node->right, identity, combine, transform, cutoff, pool);
+    group.wait();
+    auto middle = combine(std::move(left), transform(static_cast<const Key&>(node->key)));
+    return combine(std::move(middle), std::move(right));
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::erase_range(const Key *lo, const Key *hi) {
+    Node* less = nullptr;
+    Node* rest = root_;
+    if(lo){
+        std::tie(less, rest) = split(rest, *lo);
+    }
+    Node* greater = nullptr;
+    if(hi){
+        std::tie(rest, greater) = split(rest, *hi);
+    }
+    auto erased = destroy_tree(rest);
+    root_ = join(less, greater);
+    if(root_){
+        root_->parent = nullptr;
+    }
+    size_ -= erased;
+    min_node_ = find_min(root_);
+    max_node_ = find_max(root_);
+    return erased;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+std::pair<typename Tree<Key, Compare, Balance, Aggregate>::Node*, typename Tree<Key, Compare, Balance, Aggregate>::Node*>
+Tree<Key, Compare, Balance, Aggregate>::split(Node *node, const Key &key) {
+    if(!node){
+        return {nullptr, nullptr};
+    }
+    auto left = node->left;
+    auto right = node->right;
+    if(left){
+        left->parent = nullptr;
+    }
+    if(right){
+        right->parent = nullptr;
+    }
+
+    if(cmp_(node->key, key)){
+        auto parts = split(right, key);
+        return {join(left, node, parts.first), parts.second};
+    }
+    auto parts = split(left, key);
+    return {parts.first, join(parts.second, node, right)};
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::join(Node *left, Node *pivot, Node *right) {
+    //  Walk down the spine of the taller side until the heights are close
+    //  enough for pivot to take both parts as children, then rebalance on
+    //  the way back up exactly as after an insertion at that spot.
+    auto slack = balance_.join_slack();
+    if(long(height(left)) > long(height(right)) + slack){
+        left->right = join(left->right, pivot, right);
+        left->right->parent = left;
+        return balance(left);
+    }
+    if(long(height(right)) > long(height(left)) + slack){
+        right->left = join(left, pivot, right->left);
+        right->left->parent = right;
+        return balance(right);
+    }
+
+    pivot->left = left;
+    pivot->right = right;
+    pivot->parent = nullptr;
+    if(left){
+        left->parent = pivot;
+    }
+    if(right){
+        right->parent = pivot;
+    }
+    fix_height(pivot);
+    update(pivot);
+    return pivot;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::join(Node *left, Node *right) {
+    if(!left){
+        return right;
+    }
+    if(!right){
+        return left;
+    }
+    auto pivot = find_min(right);
+    right = erase_min(right);
+    if(right){
+        right->parent = nullptr;
+    }
+    return join(left, pivot, right);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::build(const std::vector<Node*> &nodes, size_t first, size_t last, Node *parent) {
+    if(first == last){
+        return nullptr;
+    }
+    auto middle = first + (last - first) / 2;
+    auto node = nodes[middle];
+    node->parent = parent;
+    node->left = build(nodes, first, middle, node);
+    node->right = build(nodes, middle + 1, last, node);
+    node->height = static_cast<unsigned char>(
+        balance_.build_height(height(node->left), height(node->right), last - first));
+    update(node);
+    return node;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::build(const Key *keys, size_t count, Node *parent,
+                                                                                                     size_t grain, thread_pool &pool) {
+    if(!count){
+        return nullptr;
+    }
+    auto middle = count / 2;
+    auto node = create_node(keys[middle], parent);
+    Node* left = nullptr;
+    Node* right = nullptr;
+    try {
+        if(count > grain){
+            task_group group(pool);
+            group.run([&](){
+                left = build(keys, middle, node, grain, pool);
+            });
+            right = build(keys + middle + 1, count - middle - 1, node, grain, pool);
+            group.wait();
+        } else {
+            left = build(keys, middle, node, grain, pool);
+            right = build(keys + middle + 1, count - middle - 1, node, grain, pool);
+        }
+    } catch(...) {
+        destroy_tree(left);
+        destroy_tree(right);
+        destroy_node(node);
+        throw;
+    }
+    node->left = left;
+    node->right = right;
+    node->height = static_cast<unsigned char>(balance_.build_height(height(left), height(right), count));
+    update(node);
+    return node;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::lower_bound(Node *node, Node *bound, const Key &key) const {
+    probe prefix(key);
+    while(node){
+        if(node_less(node, key, prefix)){
+            node = node->right;
+        } else {
+            bound = node;
+            node = node->left;
+        }
+    }
+    return bound;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+bool Tree<Key, Compare, Balance, Aggregate>::key_less(const Key &key, const probe &prefix, const Node *node) const {
+    if constexpr(key_prefix<Key, Compare>::enabled){
+        if(prefix.prefix != node->prefix){
+            return prefix.prefix < node->prefix;
+        }
+        if(prefix.length <= 8 && node->length <= 8){
+            return prefix.length < node->length;
+        }
+    }
+    return cmp_(key, node->key);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+bool Tree<Key, Compare, Balance, Aggregate>::node_less(const Node *node, const Key &key, const probe &prefix) const {
+    if constexpr(key_prefix<Key, Compare>::enabled){
+        if(prefix.prefix != node->prefix){
+            return node->prefix < prefix.prefix;
+        }
+        if(prefix.length <= 8 && node->length <= 8){
+            return node->length < prefix.length;
+        }
+    }
+    return cmp_(node->key, key);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::find_min(Node* node) const {
     if(!node){
         return nullptr;
     }
@@ -276,8 +1325,8 @@ std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::find_min(
     return find_min(node->left);
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::find_max(std::shared_ptr<Node> &node) {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::find_max(Node* node) const {
     if(!node){
         return nullptr;
     }
@@ -287,51 +1336,75 @@ std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::find_max(
     return find_max(node->right);
 }
 
-template<typename Key, typename Compare>
-size_t Tree<Key, Compare>::height(std::shared_ptr<Node> &node) {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::height(Node* node) const {
     return node == nullptr ? 0 : node->height;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::balance(std::shared_ptr<Node> &node) {
-    fix_height(node);
-    if(balance_factor(node) > MAX_IMBALANCE){
-        if(balance_factor(node->right) < 0){
-            node->right = right_rotate(node->right);
-        }
-        return left_rotate(node);
-    }
-    if(balance_factor(node) < -MAX_IMBALANCE){
-        if(balance_factor(node->left) > 0){
-            node->left = left_rotate(node->left);
-        }
-        return right_rotate(node);
-    }
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::balance(Node* node) {
+    node = balance_.balance(*this, node);
+    update(node);
     return node;
 }
 
-template<typename Key, typename Compare>
-int8_t Tree<Key, Compare>::balance_factor(std::shared_ptr<Node> &node) {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+int8_t Tree<Key, Compare, Balance, Aggregate>::balance_factor(Node* node) const {
     return height(node->right) - height(node->left);
 }
 
 
-template<typename Key, typename Compare>
-void Tree<Key, Compare>::fix_height(std::shared_ptr<Node> &node) {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::fix_height(Node* node) {
     auto h_left = height(node->left);
     auto h_right = height(node->right);
 
     node->height = std::max(h_left, h_right) + 1;
 }
 
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::update(Node *node) {
+    if constexpr (!std::is_void<aggregate_type>::value){
+        auto value = aggregate_.lift(node->key);
+        if(node->left){
+            value = aggregate_.combine(node->left->aggregate, value);
+        }
+        if(node->right){
+            value = aggregate_.combine(value, node->right->aggregate);
+        }
+        node->aggregate = value;
+    }
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::aggregate_type
+Tree<Key, Compare, Balance, Aggregate>::aggregate(const Node *node, const Key *lo, const Key *hi) const {
+    //  lo and hi are null once every key of the subtree is known to be on
+    //  their side, so only the two boundary paths are walked
+    if(!node){
+        return aggregate_.identity();
+    }
+    if(!lo && !hi){
+        return node->aggregate;
+    }
+    if(lo && cmp_(node->key, *lo)){
+        return aggregate(node->right, lo, hi);
+    }
+    if(hi && !cmp_(node->key, *hi)){
+        return aggregate(node->left, lo, hi);
+    }
+    auto value = aggregate_.combine(aggregate(node->left, lo, nullptr), aggregate_.lift(node->key));
+    return aggregate_.combine(value, aggregate(node->right, nullptr, hi));
+}
+
 
 //  --------------------------
 //  |        ROTATIONS       |
 //  --------------------------
 
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::right_rotate(std::shared_ptr<Node> &node) {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::right_rotate(Node* node) {
     if(!node){
         return node;
     }
@@ -344,14 +1417,13 @@ std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::right_rot
     }
     temp->parent = node->parent;
     node->parent = temp;
-
-    fix_height(node);
-    fix_height(temp);
+    update(node);
+    update(temp);
     return temp;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::left_rotate(std::shared_ptr<Node> &node) {
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::left_rotate(Node* node) {
     if(!node){
         return node;
     }
@@ -364,21 +1436,236 @@ std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::left_rota
     }
     temp->parent = node->parent;
     node->parent = temp;
-
-    fix_height(node);
-    fix_height(temp);
+    update(node);
+    update(temp);
     return temp;
 }
 
-template<typename Key, typename Compare>
-std::shared_ptr<typename Tree<Key, Compare>::Node> Tree<Key, Compare>::copy_tree( std::shared_ptr<Node> other, std::shared_ptr<Node> parent) {
+
+//  --------------------------
+//  |         CURSOR         |
+//  --------------------------
+
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>::cursor::cursor(const Tree &tree) {
+    push_left(tree.root_);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+Tree<Key, Compare, Balance, Aggregate>::cursor::cursor(const Tree &tree, const Key &from) {
+    for(const Node* node = tree.root_; node;){
+        if(tree.cmp_(node->key, from)){
+            node = node->right;
+        } else {
+            stack_.push_back(node);
+            node = node->left;
+        }
+    }
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+bool Tree<Key, Compare, Balance, Aggregate>::cursor::done() const {
+    return stack_.empty();
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+const typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::cursor::next() {
+    if(stack_.empty()){
+        return nullptr;
+    }
+    auto node = stack_.back();
+    stack_.pop_back();
+    push_left(node->right);
+    return node;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::cursor::push_left(const Node *node) {
+    for(; node; node = node->left){
+        stack_.push_back(node);
+    }
+}
+
+
+//  --------------------------
+//  |     NODE OWNERSHIP     |
+//  --------------------------
+
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::create_node(const Key &key, Node *parent, unsigned char h) {
+    if(arena_free_.empty()){
+        return new Node(key, parent, h);
+    }
+    auto node = new (arena_free_.back()) Node(key, parent, h);
+    arena_free_.pop_back();
+    return node;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::destroy_node(Node *node) {
+    if(!in_arena(node)){
+        delete node;
+        return;
+    }
+    node->~Node();
+    arena_free_.push_back(node);
+    if(arena_free_.size() == arena_capacity_){
+        std::allocator<Node>().deallocate(arena_, arena_capacity_);
+        arena_ = nullptr;
+        arena_capacity_ = 0;
+        arena_free_ = std::vector<Node*>();
+    }
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+bool Tree<Key, Compare, Balance, Aggregate>::in_arena(const Node *node) const {
+    std::less<const Node*> before;
+    return arena_ && !before(node, arena_) && before(node, arena_ + arena_capacity_);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::detach(Node *node) {
+    if(!node || !in_arena(node)){
+        return node;
+    }
+    auto copy = new Node(std::move_if_noexcept(*node));
+    destroy_node(node);
+    return copy;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::veb_order(Node *node, size_t levels, std::vector<Node*> &out) const {
+    if(!node){
+        return;
+    }
+    if(levels == 1){
+        out.push_back(node);
+        return;
+    }
+    //  the top half first, then every subtree hanging below it
+    auto top = levels / 2;
+    veb_order(node, top, out);
+    std::vector<Node*> bottom;
+    collect_level(node, top, bottom);
+    for(auto child: bottom){
+        veb_order(child, levels - top, out);
+    }
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::collect_level(Node *node, size_t levels, std::vector<Node*> &out) const {
+    if(!node){
+        return;
+    }
+    if(levels == 0){
+        out.push_back(node);
+        return;
+    }
+    collect_level(node->left, levels - 1, out);
+    collect_level(node->right, levels - 1, out);
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::count_levels(const Node *node) const {
+    if(!node){
+        return 0;
+    }
+    return std::max(count_levels(node->left), count_levels(node->right)) + 1;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+typename Tree<Key, Compare, Balance, Aggregate>::Node* Tree<Key, Compare, Balance, Aggregate>::copy_tree(const Node* other, Node* parent, Node*& spare) {
     if(!other){
-        return other;
+        return nullptr;
+    }
+    Node* node;
+    if(spare){
+        //  keys are rebuilt in place rather than assigned; the copy is made
+        //  first, so that a throwing one leaves the node on the spare list
+        Key copy(other->key);
+        spare->key.~Key();
+        new (&spare->key) Key(std::move(copy));
+        node = spare;
+        spare = spare->left;
+        node->cache(node->key);
+        node->left = node->right = nullptr;
+        node->parent = parent;
+        node->height = other->height;
+    } else {
+        node = create_node(other->key, parent, other->height);
+    }
+    try {
+        node->left = copy_tree(other->left, node, spare);
+        node->right = copy_tree(other->right, node, spare);
+    } catch(...) {
+        destroy_tree(node);
+        throw;
     }
-    auto node = std::make_shared<Node>(other->key, parent, other->height);
-    node->left = copy_tree(other->left, node);
-    node->right = copy_tree(other->right, node);
+    update(node);
     return node;
 }
 
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::destroy_tree(Node *node) {
+    if(!node){
+        return 0;
+    }
+    auto count = destroy_tree(node->left) + destroy_tree(node->right);
+    destroy_node(node);
+    return count + 1;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+size_t Tree<Key, Compare, Balance, Aggregate>::hand_over(Node *&node, Node *parent) {
+    if(!node){
+        return 0;
+    }
+    node = detach(node);
+    node->parent = parent;
+    return hand_over(node->left, node) + hand_over(node->right, node) + 1;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::recycle(Node *node, Node *&spare) {
+    if(!node){
+        return;
+    }
+    recycle(node->left, spare);
+    recycle(node->right, spare);
+    node->left = spare;
+    spare = node;
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+void Tree<Key, Compare, Balance, Aggregate>::destroy_list(Node *spare) {
+    while(spare){
+        auto next = spare->left;
+        destroy_node(spare);
+        spare = next;
+    }
+}
+
+template<typename Key, typename Compare, typename Balance, typename Aggregate>
+template<class Visitor>
+bool Tree<Key, Compare, Balance, Aggregate>::visit_range(const Node *node, const Key &lo, const Key &hi, Visitor &visit) const {
+    if(!node){
+        return true;
+    }
+    bool above_lo = !cmp_(node->key, lo);
+    bool below_hi = cmp_(node->key, hi);
+
+    if(above_lo && !visit_range(node->left, lo, hi, visit)){
+        return false;
+    }
+    if(above_lo && below_hi && !visit(node->key)){
+        return false;
+    }
+    if(below_hi){
+        return visit_range(node->right, lo, hi, visit);
+    }
+    return true;
+}
+
 #endif //SET_TREE_HPP
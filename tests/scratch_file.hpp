@@ -0,0 +1,43 @@
+#ifndef STL_COMPATIBLE_SET_SCRATCH_FILE_HPP
+#define STL_COMPATIBLE_SET_SCRATCH_FILE_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <dirent.h>
+#include <unistd.h>
+
+
+//  Path of a file not created yet, in a fresh directory under /tmp. The
+//  directory is removed on destruction together with every file in it, so
+//  tests may also use path as a prefix for files of their own.
+struct scratch_file {
+    std::string directory;
+    std::string path;
+
+    explicit scratch_file(const std::string& name = "data") {
+        char pattern[] = "/tmp/set_tests_XXXXXX";
+        directory = mkdtemp(pattern);
+        path = directory + "/" + name;
+    }
+
+    scratch_file(const scratch_file&) = delete;
+
+    ~scratch_file() {
+        if(auto dir = opendir(directory.c_str())){
+            while(auto entry = readdir(dir)){
+                std::string name = entry->d_name;
+                if(name != "." && name != ".."){
+                    std::remove((directory + "/" + name).c_str());
+                }
+            }
+            closedir(dir);
+        }
+        rmdir(directory.c_str());
+    }
+
+    scratch_file& operator=(const scratch_file&) = delete;
+};
+
+#endif //STL_COMPATIBLE_SET_SCRATCH_FILE_HPP
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "buffered_set.hpp"
+#include "set.hpp"
+
+
+TEST(TestBufferedSet, matches_std_set){
+    buffered_set<int> keys(256);
+    std::set<int> reference;
+    std::srand(11);
+    for(int i = 0; i < 50000; ++i){
+        auto key = std::rand() % 3000;
+        if(std::rand() % 3){
+            keys.insert(key);
+            reference.insert(key);
+        } else {
+            keys.erase(key);
+            reference.erase(key);
+        }
+        //  point queries never merge
+        auto probe = std::rand() % 3000;
+        ASSERT_EQ(keys.contains(probe), reference.count(probe) == 1);
+        EXPECT_LE(keys.pending(), keys.buffer_capacity() + 64);
+        if(i % 5000 == 0){
+            auto it = keys.lower_bound(probe);
+            auto expected = reference.lower_bound(probe);
+            ASSERT_EQ(it == keys.end(), expected == reference.end());
+            if(expected != reference.end()){
+                EXPECT_EQ(*it, *expected);
+            }
+            EXPECT_EQ(keys.pending(), 0);
+        }
+    }
+    EXPECT_EQ(keys.size(), reference.size());
+    EXPECT_TRUE(std::equal(keys.begin(), keys.end(), reference.begin(), reference.end()));
+
+    keys.clear();
+    EXPECT_TRUE(keys.empty());
+    EXPECT_FALSE(keys.contains(*reference.begin()));
+}
+
+TEST(TestBufferedSet, latest_update_wins){
+    buffered_set<std::string> keys;
+    keys.insert("a");
+    keys.erase("a");
+    keys.insert("b");
+    EXPECT_FALSE(keys.contains("a"));
+    EXPECT_TRUE(keys.contains("b"));
+    keys.flush();
+    EXPECT_EQ(keys.pending(), 0);
+
+    //  updates spread over log, run and set
+    for(int round = 0; round < 3; ++round){
+        for(int i = 0; i < 200; ++i){
+            auto key = std::to_string(i);
+            if((i + round) % 2){
+                keys.insert(key);
+            } else {
+                keys.erase(key);
+            }
+        }
+        for(int i = 0; i < 200; ++i){
+            EXPECT_EQ(keys.count(std::to_string(i)), size_t((i + round) % 2)) << round << " " << i;
+        }
+    }
+    EXPECT_EQ(keys.size(), 101);
+    EXPECT_EQ(keys.merged().size(), 101);
+    EXPECT_TRUE(keys.find("b") != keys.end());
+    EXPECT_EQ(*keys.upper_bound("198"), "199");
+}
+
+TEST(TestBufferedSet, merge_sorted){
+    for(bool indexed: {false, true}){
+        set<int> keys;
+        if(indexed){
+            keys.enable_hash_index();
+        }
+        std::set<int> reference;
+        //  the first batch leaves the inline mode, then small batches go key
+        //  by key and large ones relink the tree
+        for(int batch: {0, 3, 40, 5, 1000}){
+            std::vector<int> add;
+            std::vector<int> drop;
+            for(int key = 0; key < 3000; ++key){
+                if(key % 7 == batch % 7 && key % 2 == 0){
+                    add.push_back(key);
+                } else if(key % 11 == batch % 11 && key % 2 == 1){
+                    drop.push_back(key);
+                }
+            }
+            if(batch == 40){
+                add.resize(4);
+                drop.resize(4);
+            }
+            for(auto key: add){
+                reference.insert(key);
+            }
+            for(auto key: drop){
+                reference.erase(key);
+            }
+            keys.merge_sorted(add.data(), add.data() + add.size(), drop.data(), drop.data() + drop.size());
+            ASSERT_TRUE(std::equal(keys.begin(), keys.end(), reference.begin(), reference.end()));
+            for(auto key: add){
+                EXPECT_TRUE(keys.contains(key));
+            }
+            for(auto key: drop){
+                EXPECT_FALSE(keys.contains(key));
+            }
+        }
+        EXPECT_EQ(keys.size(), reference.size());
+        std::vector<int> everything(reference.begin(), reference.end());
+        keys.merge_sorted(nullptr, nullptr, everything.data(), everything.data() + everything.size());
+        EXPECT_TRUE(keys.empty());
+        EXPECT_TRUE(keys.begin() == keys.end());
+    }
+}
+
+TEST(TestBufferedSet, stateful_compare){
+    //  descending or ascending by a flag, so that a default-constructed
+    //  comparator would order the set differently from the buffer
+    struct flag_order {
+        bool descending = false;
+
+        bool operator()(int lhs, int rhs) const {
+            return descending ? rhs < lhs : lhs < rhs;
+        }
+    };
+    flag_order order{true};
+    buffered_set<int, flag_order> keys(64, order);
+    std::set<int, flag_order> reference(order);
+    for(int i = 0; i < 1000; ++i){
+        int key = (i * 53) % 400;
+        if(i % 4){
+            keys.insert(key);
+            reference.insert(key);
+        } else {
+            keys.erase(key);
+            reference.erase(key);
+        }
+    }
+    EXPECT_TRUE(keys.contains(*reference.begin()));
+    EXPECT_TRUE(std::equal(keys.begin(), keys.end(), reference.begin(), reference.end()));
+    EXPECT_EQ(*keys.lower_bound(200), *reference.lower_bound(200));
+}
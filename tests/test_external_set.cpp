@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "external_set.hpp"
+#include "scratch_file.hpp"
+
+
+TEST(TestExternalSet, random_updates){
+    scratch_file file;
+    //  small pages and a tiny pool force splits, merges and evictions
+    external_set<long>::options options;
+    options.page_size = 256;
+    options.pool_pages = 8;
+    external_set<long> set(file.path, options);
+    std::set<long> reference;
+    srand(9);
+    for(int i = 0; i < 30000; ++i){
+        long key = rand() % 4000;
+        if(rand() % 3){
+            EXPECT_EQ(set.insert(key), reference.insert(key).second);
+        } else {
+            EXPECT_EQ(set.erase(key), reference.erase(key) == 1);
+        }
+    }
+    EXPECT_EQ(set.size(), reference.size());
+    EXPECT_GT(set.height(), 2);
+    EXPECT_TRUE(std::equal(set.begin(), set.end(), reference.begin(), reference.end()));
+    for(long key = -1; key <= 4001; key += 11){
+        EXPECT_EQ(set.contains(key), reference.count(key) == 1);
+        auto it = set.lower_bound(key);
+        auto expected = reference.lower_bound(key);
+        EXPECT_EQ(it == set.end(), expected == reference.end());
+        if(expected != reference.end()){
+            EXPECT_EQ(*it, *expected);
+        }
+    }
+    for(auto key: std::vector<long>(reference.begin(), reference.end())){
+        EXPECT_TRUE(set.erase(key));
+    }
+    EXPECT_TRUE(set.empty());
+    EXPECT_EQ(set.height(), 1);
+    EXPECT_TRUE(set.begin() == set.end());
+}
+
+TEST(TestExternalSet, reopen){
+    scratch_file file;
+    {
+        external_set<int> set(file.path);
+        for(int i = 0; i < 50000; ++i){
+            set.insert(i * 3);
+        }
+        set.erase(300);
+    }
+    external_set<int> set(file.path);
+    EXPECT_EQ(set.size(), 49999);
+    EXPECT_FALSE(set.contains(300));
+    EXPECT_TRUE(set.contains(303));
+    EXPECT_EQ(*set.lower_bound(301), 303);
+    EXPECT_EQ(std::distance(set.begin(), set.end()), 49999);
+}
+
+TEST(TestExternalSet, bounded_page_reads){
+    scratch_file file;
+    external_set<int>::options options;
+    options.pool_pages = 8;
+    external_set<int> set(file.path, options);
+    for(int i = 0; i < 200000; ++i){
+        set.insert(i);
+    }
+    auto before = set.page_reads();
+    for(int i = 0; i < 1000; ++i){
+        set.contains(rand() % 200000);
+    }
+    //  one read per level at most, the pool keeps the upper levels
+    EXPECT_LE(set.page_reads() - before, 1000 * set.height());
+    EXPECT_LE(set.height(), 3);
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "frozen_set.hpp"
+#include "set.hpp"
+
+
+TEST(TestFrozenSet, strings){
+    set<std::string> keys;
+    srand(4);
+    for(int i = 0; i < 5000; ++i){
+        keys.insert("https://example.com/catalog/item/" + std::to_string(rand() % 100000) + "/view");
+    }
+    keys.insert("");
+    frozen_string_set frozen(keys.begin(), keys.end());
+    EXPECT_EQ(frozen.size(), keys.size());
+    EXPECT_TRUE(std::equal(frozen.begin(), frozen.end(), keys.begin(), keys.end()));
+
+    for(auto probe: {std::string(""), std::string("a"), std::string("https://example.com/catalog/item/5"),
+                     std::string("https://example.com/catalog/item/99999/view"), std::string("zzz")}){
+        auto it = frozen.lower_bound(probe);
+        auto expected = keys.lower_bound(probe);
+        EXPECT_EQ(it == frozen.end(), expected == keys.end());
+        if(expected != keys.end()){
+            EXPECT_EQ(*it, *expected);
+        }
+    }
+    for(auto& key: keys){
+        EXPECT_TRUE(frozen.contains(key));
+    }
+    EXPECT_FALSE(frozen.contains("https://example.com/catalog/item/"));
+    EXPECT_LT(frozen.memory_usage().total() * 4, keys.memory_usage().total());
+}
+
+TEST(TestFrozenSet, integers){
+    std::vector<long> values;
+    srand(6);
+    for(long value = -500000; value < 500000; value += 1 + rand() % 5){
+        values.push_back(value);
+    }
+    values.push_back(std::numeric_limits<long>::max());
+    frozen_int_set<long> frozen(values.begin(), values.end());
+    EXPECT_EQ(frozen.size(), values.size());
+    EXPECT_TRUE(std::equal(frozen.begin(), frozen.end(), values.begin(), values.end()));
+    for(long probe = -500100; probe < 500100; probe += 997){
+        auto it = frozen.lower_bound(probe);
+        auto expected = std::lower_bound(values.begin(), values.end(), probe);
+        EXPECT_EQ(*it, *expected);
+        EXPECT_EQ(frozen.contains(probe), *expected == probe);
+    }
+    EXPECT_TRUE(frozen.lower_bound(std::numeric_limits<long>::min()) == frozen.begin());
+    EXPECT_TRUE(frozen.contains(std::numeric_limits<long>::max()));
+    //  gaps of at most five take three bits
+    EXPECT_LT(frozen.memory_usage().total(), values.size());
+
+    frozen_int_set<unsigned> empty;
+    EXPECT_TRUE(empty.begin() == empty.end());
+    EXPECT_FALSE(empty.contains(0));
+}
+
+template <class T>
+void check_narrow_keys(const std::vector<T>& values) {
+    frozen_int_set<T> frozen(values.begin(), values.end());
+    EXPECT_EQ(frozen.size(), values.size());
+    EXPECT_TRUE(std::equal(frozen.begin(), frozen.end(), values.begin(), values.end()));
+    for(auto value: values){
+        EXPECT_TRUE(frozen.contains(value));
+    }
+}
+
+TEST(TestFrozenSet, narrow_integers){
+    //  gaps of types narrower than int are computed in int, and must not
+    //  turn negative when the keys cross zero
+    std::vector<short> shorts{-2};
+    for(short value = 0; value <= 70; ++value){
+        shorts.push_back(value);
+    }
+    check_narrow_keys(shorts);
+    check_narrow_keys(std::vector<short>{std::numeric_limits<short>::min(), -300, -1, 0, 5, 300,
+                                         std::numeric_limits<short>::max()});
+
+    std::vector<int8_t> bytes;
+    for(int value = -128; value < 128; value += 3){
+        bytes.push_back(int8_t(value));
+    }
+    check_narrow_keys(bytes);
+    check_narrow_keys(std::vector<int8_t>{-128, -1, 0, 1, 127});
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "rcu_set.hpp"
+
+
+TEST(TestRcuSet, random_updates){
+    rcu_set<int> set;
+    std::set<int> reference;
+    auto reader = set.make_reader();
+    srand(7);
+    for(int i = 0; i < 20000; ++i){
+        int key = rand() % 2000;
+        if(rand() % 3){
+            EXPECT_EQ(set.insert(key), reference.insert(key).second);
+        } else {
+            EXPECT_EQ(set.erase(key), reference.erase(key) == 1);
+        }
+    }
+    EXPECT_EQ(set.size(), reference.size());
+    auto snapshot = reader.pin();
+    EXPECT_TRUE(std::equal(snapshot.begin(), snapshot.end(), reference.begin(), reference.end()));
+    for(int key = -1; key <= 2000; key += 7){
+        EXPECT_EQ(snapshot.contains(key), reference.count(key) == 1);
+        auto it = snapshot.lower_bound(key);
+        auto expected = reference.lower_bound(key);
+        if(expected == reference.end()){
+            EXPECT_TRUE(it == snapshot.end());
+        } else {
+            EXPECT_EQ(*it, *expected);
+        }
+    }
+}
+
+TEST(TestRcuSet, snapshot_isolation){
+    rcu_set<int> set;
+    for(int i = 0; i < 100; ++i){
+        set.insert(i);
+    }
+    auto reader = set.make_reader();
+    {
+        auto snapshot = reader.pin();
+        for(int i = 0; i < 100; i += 2){
+            set.erase(i);
+        }
+        set.insert(1000);
+        set.reclaim();
+        //  the pinned version keeps its nodes
+        EXPECT_GT(set.retired(), 0);
+        EXPECT_EQ(std::distance(snapshot.begin(), snapshot.end()), 100);
+        EXPECT_TRUE(snapshot.contains(0));
+        EXPECT_FALSE(snapshot.contains(1000));
+    }
+    set.reclaim();
+    EXPECT_EQ(set.retired(), 0);
+    auto snapshot = reader.pin();
+    EXPECT_EQ(std::distance(snapshot.begin(), snapshot.end()), 51);
+    EXPECT_FALSE(snapshot.contains(0));
+    EXPECT_TRUE(snapshot.contains(1000));
+
+    set.clear();
+    EXPECT_EQ(set.size(), 0);
+    EXPECT_FALSE(snapshot.empty());
+    EXPECT_TRUE(reader.pin().empty());
+}
+
+TEST(TestRcuSet, concurrent_readers){
+    //  the writer only ever inserts and erases odd keys, so every version a
+    //  reader sees holds all even keys in order
+    rcu_set<int> set;
+    for(int i = 0; i < 1000; i += 2){
+        set.insert(i);
+    }
+    std::atomic<bool> stop{false};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> readers;
+    for(int t = 0; t < 3; ++t){
+        readers.emplace_back([&](){
+            auto reader = set.make_reader();
+            while(!stop){
+                auto snapshot = reader.pin();
+                int evens = 0;
+                int last = -1;
+                for(int key: snapshot){
+                    failures += key <= last;
+                    last = key;
+                    evens += key % 2 == 0;
+                }
+                failures += evens != 500;
+                failures += !snapshot.contains(500);
+            }
+        });
+    }
+    srand(11);
+    for(int i = 0; i < 20000; ++i){
+        int key = 2 * (rand() % 500) + 1;
+        if(rand() % 2){
+            set.insert(key);
+        } else {
+            set.erase(key);
+        }
+    }
+    stop = true;
+    for(auto& thread: readers){
+        thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+    set.reclaim();
+    EXPECT_EQ(set.retired(), 0);
+}
@@ -1,5 +1,13 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 #include "set.hpp"
 
@@ -182,3 +190,694 @@ TEST_F(TestSet, lower_bound){
     it = s3_int.lower_bound(100);
     EXPECT_TRUE(it == s3_int.end());
 }
+
+TEST_F(TestSet, memory_usage){
+    set<int> large;
+    for(int i = 0; i < 100; ++i){
+        large.insert(i);
+    }
+    auto empty = s_default.memory_usage();
+    auto filled = large.memory_usage();
+    EXPECT_EQ(empty.nodes, 0);
+    EXPECT_EQ(empty.node_bytes, 0);
+    EXPECT_EQ(s3_int.memory_usage().nodes, 0);
+    EXPECT_EQ(filled.nodes, 100);
+    EXPECT_EQ(filled.node_bytes, 100 * sizeof(Tree<int>::Node));
+    EXPECT_EQ(filled.overhead_bytes, 100 * allocation_overhead(sizeof(Tree<int>::Node)));
+    EXPECT_GT(filled.overhead_bytes, 0);
+    EXPECT_EQ(filled.key_bytes, 0);
+
+    //  a compacted set is one allocation, whose slots stay held after erases
+    large.compact();
+    auto compacted = large.memory_usage();
+    EXPECT_EQ(compacted.node_bytes, filled.node_bytes);
+    EXPECT_LT(compacted.overhead_bytes, filled.overhead_bytes);
+    for(int i = 0; i < 50; ++i){
+        large.erase(i);
+    }
+    auto holes = large.memory_usage();
+    EXPECT_EQ(holes.node_bytes, 50 * sizeof(Tree<int>::Node));
+    EXPECT_GE(holes.overhead_bytes, compacted.overhead_bytes + 50 * sizeof(Tree<int>::Node));
+    EXPECT_GE(holes.total(), compacted.total());
+
+    set<std::string> strings{"short", std::string(100, 'x')};
+    EXPECT_GT(strings.memory_usage().key_bytes, 100);
+}
+
+TEST_F(TestSet, memory_registry){
+    auto& registry = memory_registry::instance();
+    {
+        auto first = registry.track("ids", s3_int);
+        auto second = registry.track("ids", s4_int);
+        auto totals = registry.totals();
+        EXPECT_EQ(totals["ids"].object_bytes, 2 * sizeof(s3_int));
+        EXPECT_EQ(totals["ids"].total(), s3_int.memory_usage().total() + s4_int.memory_usage().total());
+    }
+    EXPECT_EQ(registry.totals().count("ids"), 0);
+}
+
+TEST_F(TestSet, upper_bound){
+    EXPECT_EQ(*s3_int.upper_bound(-1), 0);
+    EXPECT_EQ(*s3_int.upper_bound(0), 1);
+    EXPECT_TRUE(s3_int.upper_bound(2) == s3_int.end());
+}
+
+TEST_F(TestSet, equal_range_count){
+    auto range = s3_int.equal_range(1);
+    EXPECT_EQ(*range.first, 1);
+    EXPECT_EQ(*range.second, 2);
+    EXPECT_EQ(s3_int.count(1), 1);
+
+    range = s3_int.equal_range(5);
+    EXPECT_TRUE(range.first == range.second);
+    EXPECT_EQ(s3_int.count(5), 0);
+}
+
+TEST_F(TestSet, range_scan){
+    set<int> test;
+    for(int i = 0; i < 100; ++i){
+        test.insert(i * 2);
+    }
+    std::vector<int> keys;
+    test.for_each_in_range(9, 21, [&keys](int key){ keys.push_back(key); });
+    EXPECT_EQ(keys, std::vector<int>({10, 12, 14, 16, 18, 20}));
+
+    keys.clear();
+    EXPECT_FALSE(test.visit_range(0, 200, [&keys](int key){
+        keys.push_back(key);
+        return keys.size() < 3;
+    }));
+    EXPECT_EQ(keys, std::vector<int>({0, 2, 4}));
+}
+
+TEST_F(TestSet, balance_policy){
+    set<int, std::less<int>, red_black_balance> red_black{5, 1, 4, 2, 3};
+    set<int, std::less<int>, relaxed_avl_balance> relaxed(relaxed_avl_balance(4));
+    for(int i = 5; i > 0; --i){
+        relaxed.insert(i);
+    }
+    red_black.erase(4);
+    relaxed.erase(4);
+    EXPECT_EQ(std::vector<int>(red_black.begin(), red_black.end()), std::vector<int>({1, 2, 3, 5}));
+    EXPECT_EQ(std::vector<int>(relaxed.begin(), relaxed.end()), std::vector<int>({1, 2, 3, 5}));
+}
+
+namespace {
+
+//  Key type with the inline mode disabled.
+struct tree_only_key {
+    int value;
+
+    bool operator<(const tree_only_key& other) const {
+        return value < other.value;
+    }
+};
+
+}
+
+template <>
+struct small_set_capacity<tree_only_key> {
+    static constexpr size_t value = 0;
+};
+
+TEST_F(TestSet, tree_only_mode){
+    set<tree_only_key> test;
+    for(int round = 0; round < 2; ++round){
+        for(int i = 0; i < 10; ++i){
+            test.insert({i});
+            EXPECT_EQ(test.memory_usage().nodes, size_t(i + 1));
+        }
+        //  without the inline mode iterators survive erasing other keys
+        for(auto it = test.begin(); it != test.end();){
+            auto key = it->value;
+            ++it;
+            if(key % 2 == 0){
+                test.erase({key});
+            }
+        }
+        EXPECT_EQ(test.size(), 5);
+        EXPECT_EQ(test.min().value, 1);
+        for(int i = 0; i < 10; ++i){
+            test.erase({i});
+        }
+        EXPECT_TRUE(test.empty());
+        EXPECT_EQ(test.memory_usage().nodes, 0);
+    }
+}
+
+TEST_F(TestSet, small_mode){
+    const int capacity = small_set_capacity<int>::value;
+    set<int> test;
+    for(int i = capacity; i >= 0; --i){
+        test.insert(i);
+        EXPECT_EQ(test.memory_usage().nodes, i ? 0 : capacity + 1);
+    }
+    EXPECT_EQ(test.size(), capacity + 1);
+
+    int check = 0;
+    for(auto item: test){
+        EXPECT_EQ(item, check++);
+    }
+    EXPECT_EQ(*test.rbegin(), capacity);
+
+    for(int i = 0; i <= capacity / 2; ++i){
+        test.erase(i);
+    }
+    EXPECT_EQ(test.memory_usage().nodes, 0);
+    EXPECT_EQ(*test.begin(), capacity / 2 + 1);
+    EXPECT_EQ(*(--test.end()), capacity);
+    EXPECT_EQ(*test.lower_bound(0), capacity / 2 + 1);
+    EXPECT_TRUE(test.find(0) == test.end());
+    EXPECT_EQ(test.count(capacity), 1);
+}
+
+TEST_F(TestSet, hash_index){
+    set<int> test;
+    test.enable_hash_index();
+    EXPECT_TRUE(test.has_hash_index());
+    for(int i = 0; i < 1000; ++i){
+        test.insert(i * 3);
+    }
+    for(int i = 0; i < 1000; i += 2){
+        test.erase(i * 3);
+    }
+    for(int i = 0; i < 3000; ++i){
+        EXPECT_EQ(test.contains(i), i % 6 == 3);
+    }
+    EXPECT_EQ(*test.find(9), 9);
+    EXPECT_EQ(*(++test.find(9)), 15);
+    EXPECT_TRUE(test.find(6) == test.end());
+    EXPECT_GT(test.memory_usage().overhead_bytes, 0);
+
+    auto copy = test;
+    test.erase(9);
+    EXPECT_EQ(copy.count(9), 1);
+    EXPECT_EQ(test.count(9), 0);
+
+    for(int i = 0; i < 3000; ++i){
+        test.erase(i);
+    }
+    test.insert(1);
+    EXPECT_TRUE(test.contains(1));
+    test.disable_hash_index();
+    EXPECT_TRUE(test.contains(1));
+}
+
+TEST_F(TestSet, finger_search){
+    set<int> test;
+    for(int i = 0; i < 1000; ++i){
+        test.insert(i * 2);
+    }
+    auto hint = test.begin();
+    for(int i = 0; i < 1999; ++i){
+        auto it = test.lower_bound(hint, i);
+        EXPECT_EQ(*it, i + i % 2);
+        EXPECT_EQ(test.find(hint, i) != test.end(), i % 2 == 0);
+        hint = it;
+    }
+    EXPECT_TRUE(test.lower_bound(hint, 5000) == test.end());
+    EXPECT_EQ(*test.lower_bound(test.end(), 7), 8);
+    EXPECT_EQ(*test.find(test.end(), 1998), 1998);
+
+    test.use_finger_cache(true);
+    for(int i = 1998; i >= 0; i -= 3){
+        EXPECT_EQ(test.find(i) != test.end(), i % 2 == 0);
+        EXPECT_EQ(*test.lower_bound(i), i + i % 2);
+    }
+    test.erase(500);
+    EXPECT_TRUE(test.find(500) == test.end());
+    EXPECT_EQ(*test.lower_bound(499), 502);
+}
+
+TEST_F(TestSet, range_erase){
+    set<int> test;
+    for(int i = 0; i < 1000; ++i){
+        test.insert(i);
+    }
+    test.enable_hash_index();
+    test.use_finger_cache(true);
+    EXPECT_EQ(*test.lower_bound(450), 450);
+
+    test.erase(100, 500);
+    EXPECT_EQ(test.size(), 600);
+    EXPECT_FALSE(test.contains(100));
+    EXPECT_FALSE(test.contains(499));
+    EXPECT_TRUE(test.contains(99));
+    EXPECT_TRUE(test.contains(500));
+    EXPECT_EQ(*test.lower_bound(450), 500);
+
+    test.erase(test.find(900), test.end());
+    EXPECT_EQ(test.size(), 500);
+    EXPECT_EQ(*test.rbegin(), 899);
+    test.erase(test.begin(), test.find(50));
+    EXPECT_EQ(*test.begin(), 50);
+    test.erase(test.begin(), test.begin());
+    test.erase(10, 5);
+    EXPECT_EQ(test.size(), 450);
+
+    EXPECT_EQ(test.erase_if([](int key){ return key % 2 == 1; }), 225);
+    EXPECT_EQ(test.size(), 225);
+    EXPECT_TRUE(test.contains(600));
+    EXPECT_FALSE(test.contains(601));
+    int expected = 50;
+    for(auto key: test){
+        EXPECT_EQ(key, expected);
+        expected += expected == 98 ? 402 : 2;
+    }
+
+    //  shrinking into the inline array keeps working there
+    test.erase(60, 890);
+    EXPECT_EQ(test.size(), 10);
+    EXPECT_EQ(test.erase_if([](int key){ return key > 55; }), 7);
+    test.erase(test.begin(), std::next(test.begin()));
+    EXPECT_EQ(std::vector<int>(test.begin(), test.end()), std::vector<int>({52, 54}));
+}
+
+TEST_F(TestSet, node_handles){
+    set<int> source;
+    set<int> target;
+    for(int i = 0; i < 100; ++i){
+        source.insert(i);
+    }
+    target.enable_hash_index();
+
+    auto node = source.extract(42);
+    ASSERT_FALSE(node.empty());
+    EXPECT_EQ(node.value(), 42);
+    const int* key = &node.value();
+    EXPECT_FALSE(source.contains(42));
+    EXPECT_EQ(source.size(), 99);
+    EXPECT_TRUE(source.extract(42).empty());
+
+    for(int i = 1000; i < 1020; ++i){
+        target.insert(i);
+    }
+    auto result = target.insert(std::move(node));
+    EXPECT_TRUE(result.inserted);
+    EXPECT_TRUE(result.node.empty());
+    EXPECT_EQ(&*result.position, key);
+    EXPECT_TRUE(target.contains(42));
+
+    node = source.extract(source.find(7));
+    node.value() = 1000;
+    result = target.insert(std::move(node));
+    EXPECT_FALSE(result.inserted);
+    EXPECT_EQ(result.node.value(), 1000);
+    EXPECT_EQ(*result.position, 1000);
+
+    //  small sets copy keys in and out of their inline array
+    set<int> small{1, 2, 3};
+    node = small.extract(2);
+    EXPECT_EQ(node.value(), 2);
+    EXPECT_EQ(small.size(), 2);
+    EXPECT_TRUE(small.insert(std::move(node)).inserted);
+    EXPECT_TRUE(small.contains(2));
+    EXPECT_FALSE(small.insert(set<int>::node_type()).inserted);
+}
+
+TEST_F(TestSet, merge){
+    set<int> source;
+    set<int> target;
+    for(int i = 0; i < 200; ++i){
+        source.insert(i);
+    }
+    for(int i = 0; i < 200; i += 4){
+        target.insert(i);
+    }
+    source.enable_hash_index();
+
+    target.merge(source);
+    EXPECT_EQ(target.size(), 200);
+    EXPECT_EQ(source.size(), 50);
+    for(int i = 0; i < 200; ++i){
+        EXPECT_TRUE(target.contains(i));
+        EXPECT_EQ(source.contains(i), i % 4 == 0);
+    }
+
+    set<int> small{5, 500, 1000};
+    target.merge(small);
+    EXPECT_EQ(std::vector<int>(small.begin(), small.end()), std::vector<int>({5}));
+    EXPECT_TRUE(target.contains(1000));
+    target.merge(target);
+    EXPECT_EQ(target.size(), 202);
+}
+
+TEST_F(TestSet, aggregate){
+    set<int, std::less<int>, avl_balance, sum_aggregate<long>> sums;
+    for(int i = 1; i <= 10; ++i){
+        sums.insert(i);
+    }
+    EXPECT_EQ(sums.aggregate(), 55);
+    EXPECT_EQ(sums.aggregate(3, 6), 12);
+    for(int i = 11; i <= 1000; ++i){
+        sums.insert(i);
+    }
+    EXPECT_EQ(sums.aggregate(), 500500);
+    EXPECT_EQ(sums.aggregate(101, 201), 15050);
+    sums.erase(150);
+    EXPECT_EQ(sums.aggregate(101, 201), 14900);
+    EXPECT_EQ(sums.aggregate(201, 101), 0);
+
+    //  intervals keyed by their start: any interval starting before a point
+    //  overlaps it iff the largest end among them lies beyond the point
+    struct interval_end {
+        int operator()(const std::pair<int, int>& interval) const {
+            return interval.second;
+        }
+    };
+    set<std::pair<int, int>, std::less<std::pair<int, int>>, avl_balance,
+        max_aggregate<int, interval_end>> intervals;
+    for(int i = 0; i < 100; ++i){
+        intervals.insert({i * 10, i * 10 + 3});
+    }
+    intervals.insert({200, 260});
+    auto overlaps = [&intervals](int point){
+        return intervals.aggregate({std::numeric_limits<int>::min(), 0}, {point + 1, 0}) > point;
+    };
+    EXPECT_TRUE(overlaps(252));
+    EXPECT_FALSE(overlaps(265));
+    EXPECT_TRUE(overlaps(502));
+    EXPECT_FALSE(overlaps(505));
+}
+
+TEST_F(TestSet, parallel_algorithms){
+    thread_pool pool(4);
+    set<int> test;
+    for(int i = 0; i < 20000; ++i){
+        test.insert(i);
+    }
+
+    std::atomic<long> sum{0};
+    test.parallel_for_each([&sum](int key){ sum += key; }, pool);
+    EXPECT_EQ(sum, 199990000L);
+    EXPECT_EQ(test.parallel_reduce(0L, std::plus<long>(), pool), 199990000L);
+    EXPECT_EQ(test.parallel_count_if([](int key){ return key % 3 == 0; }, pool), 6667);
+
+    //  concatenation is not commutative: the parts must come back in order
+    auto keys = test.parallel_transform_reduce(std::vector<int>(), [](std::vector<int> lhs, std::vector<int> rhs){
+        lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+        return lhs;
+    }, [](int key){ return std::vector<int>{key}; }, pool);
+    EXPECT_EQ(keys, std::vector<int>(test.begin(), test.end()));
+
+    set<int> small{3, 1, 2};
+    EXPECT_EQ(small.parallel_reduce(0, std::plus<int>(), pool), 6);
+    EXPECT_EQ(small.parallel_count_if([](int key){ return key > 1; }, pool), 2);
+}
+
+TEST_F(TestSet, subrange){
+    for(int count: {0, 1, 10, 1000}){
+        set<int> test;
+        for(int i = 0; i < count; ++i){
+            test.insert(i);
+        }
+        std::vector<set<int>::subrange> parts{test.range()};
+        for(int round = 0; round < 6; ++round){
+            std::vector<set<int>::subrange> next;
+            for(auto part: parts){
+                if(part.is_divisible()){
+                    auto upper = part.split();
+                    EXPECT_FALSE(part.empty());
+                    EXPECT_FALSE(upper.empty());
+                    next.push_back(part);
+                    next.push_back(upper);
+                } else {
+                    next.push_back(part);
+                }
+            }
+            parts = next;
+        }
+        std::vector<int> keys;
+        for(auto part: parts){
+            keys.insert(keys.end(), part.begin(), part.end());
+        }
+        EXPECT_EQ(keys, std::vector<int>(test.begin(), test.end()));
+        if(count == 1000){
+            //  64 parts of a 1000 key tree: none should be far off the mean
+            EXPECT_EQ(parts.size(), 64);
+            for(auto part: parts){
+                EXPECT_LT(std::distance(part.begin(), part.end()), 64);
+            }
+        }
+    }
+}
+
+TEST_F(TestSet, parallel_construction){
+    thread_pool pool(4);
+    std::vector<int> input;
+    std::srand(3);
+    for(int i = 0; i < 60000; ++i){
+        input.push_back(std::rand() % 40000);
+    }
+    set<int> test(parallel_policy{&pool}, input.begin(), input.end());
+    std::set<int> expected(input.begin(), input.end());
+    EXPECT_EQ(test.size(), expected.size());
+    EXPECT_TRUE(std::equal(test.begin(), test.end(), expected.begin(), expected.end()));
+    test.insert(-1);
+    test.erase(expected.count(5) ? 5 : *expected.begin());
+    EXPECT_EQ(*test.begin(), -1);
+
+    std::vector<int> few{5, 3, 5, 1, 3};
+    set<int> small(parallel_execution, few.begin(), few.end());
+    EXPECT_EQ(std::vector<int>(small.begin(), small.end()), std::vector<int>({1, 3, 5}));
+    set<int> empty(parallel_execution, few.begin(), few.begin());
+    EXPECT_TRUE(empty.empty());
+}
+
+TEST_F(TestSet, copy_range){
+    set<int> test;
+    for(int i = 0; i < 1000; ++i){
+        test.insert(i * 2);
+    }
+
+    int buffer[64];
+    EXPECT_EQ(test.copy_range(501, buffer, 3), 3);
+    EXPECT_EQ(buffer[0], 502);
+    EXPECT_EQ(buffer[2], 506);
+    EXPECT_EQ(test.copy_range(5000, buffer, 3), 0);
+
+    std::vector<int> keys;
+    auto cursor = test.make_cursor(100);
+    size_t copied;
+    while((copied = test.copy_range(cursor, buffer, 64)) != 0){
+        keys.insert(keys.end(), buffer, buffer + copied);
+    }
+    EXPECT_TRUE(cursor.done());
+    EXPECT_EQ(keys, std::vector<int>(test.lower_bound(100), test.end()));
+
+    set<int> small{4, 1, 3};
+    std::vector<int> out;
+    auto small_cursor = small.make_cursor();
+    EXPECT_EQ(small.copy_range(small_cursor, std::back_inserter(out), 2), 2);
+    EXPECT_FALSE(small_cursor.done());
+    EXPECT_EQ(small.copy_range(small_cursor, std::back_inserter(out), 2), 1);
+    EXPECT_EQ(out, std::vector<int>({1, 3, 4}));
+    EXPECT_TRUE(set<int>::cursor().done());
+}
+
+TEST_F(TestSet, assignment_swap_clear){
+    set<std::string> first;
+    set<std::string> second;
+    for(int i = 0; i < 500; ++i){
+        first.insert("first-" + std::to_string(i));
+        second.insert("second-" + std::to_string(i * 7));
+    }
+    first.enable_hash_index();
+
+    //  copy assignment between sets of equal size reuses every node
+    std::set<const std::string*> nodes;
+    for(auto& key: first){
+        nodes.insert(&key);
+    }
+    first = second;
+    EXPECT_TRUE(std::equal(first.begin(), first.end(), second.begin(), second.end()));
+    EXPECT_FALSE(first.has_hash_index());
+    for(auto& key: first){
+        EXPECT_EQ(nodes.count(&key), 1);
+    }
+
+    auto before = &*second.begin();
+    set<std::string> target{"x"};
+    target = std::move(second);
+    EXPECT_EQ(&*target.begin(), before);
+    EXPECT_TRUE(second.empty());
+    second.insert("again");
+    EXPECT_EQ(second.size(), 1);
+    static_assert(std::is_nothrow_move_assignable<set<std::string>>::value, "move assignment is noexcept");
+    static_assert(std::is_nothrow_move_constructible<set<std::string>>::value, "move construction is noexcept");
+
+    swap(target, second);
+    EXPECT_EQ(&*second.begin(), before);
+    EXPECT_EQ(second.size(), 500);
+    EXPECT_EQ(*target.begin(), "again");
+
+    second.clear();
+    EXPECT_TRUE(second.empty());
+    EXPECT_TRUE(second.begin() == second.end());
+    second.insert("after");
+    EXPECT_TRUE(second.contains("after"));
+
+    first.clear();
+    first.enable_hash_index();
+    for(int i = 0; i < 100; ++i){
+        first.insert(std::to_string(i));
+    }
+    first = first;
+    EXPECT_EQ(first.size(), 100);
+    EXPECT_TRUE(first.contains("42"));
+}
+
+TEST_F(TestSet, priority_queue){
+    //  crosses between the inline array and the tree in both directions
+    set<int> queue;
+    queue.enable_hash_index();
+    queue.use_finger_cache(true);
+    std::set<int> expected;
+    std::srand(3);
+    for(int round = 0; round < 50; ++round){
+        for(int i = 0; i < 40; ++i){
+            int key = std::rand() % 500;
+            queue.insert(key);
+            expected.insert(key);
+        }
+        queue.find(*expected.begin());
+        for(int i = 0; i < 30 && !expected.empty(); ++i){
+            ASSERT_EQ(queue.min(), *expected.begin());
+            ASSERT_EQ(queue.max(), *expected.rbegin());
+            if(i % 2){
+                EXPECT_EQ(queue.pop_min(), *expected.begin());
+                expected.erase(expected.begin());
+            } else {
+                EXPECT_EQ(queue.pop_max(), *expected.rbegin());
+                expected.erase(std::prev(expected.end()));
+            }
+        }
+        ASSERT_EQ(queue.size(), expected.size());
+        for(int key = 0; key < 500; key += 7){
+            ASSERT_EQ(queue.contains(key), expected.count(key) == 1);
+        }
+    }
+    EXPECT_TRUE(std::equal(queue.begin(), queue.end(), expected.begin(), expected.end()));
+
+    std::vector<int> taken;
+    EXPECT_EQ(queue.extract_min_n(25, std::back_inserter(taken)), 25);
+    EXPECT_TRUE(std::equal(taken.begin(), taken.end(), expected.begin()));
+    expected.erase(expected.begin(), std::next(expected.begin(), 25));
+    EXPECT_EQ(queue.min(), *expected.begin());
+    EXPECT_FALSE(queue.contains(taken.back()));
+    EXPECT_EQ(queue.size(), expected.size());
+
+    taken.clear();
+    EXPECT_EQ(queue.extract_min_n(0, std::back_inserter(taken)), 0);
+    EXPECT_EQ(queue.extract_min_n(100000, std::back_inserter(taken)), expected.size());
+    EXPECT_TRUE(std::equal(taken.begin(), taken.end(), expected.begin(), expected.end()));
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(queue.extract_min_n(3, std::back_inserter(taken)), 0);
+
+    set<std::string> words{"pear", "apple", "fig"};
+    EXPECT_EQ(words.pop_min(), "apple");
+    EXPECT_EQ(words.pop_max(), "pear");
+    EXPECT_EQ(words.min(), "fig");
+    EXPECT_EQ(words.max(), "fig");
+}
+
+TEST_F(TestSet, compact){
+    for(auto order: {compact_order::in_order, compact_order::van_emde_boas}){
+        set<std::string> keys;
+        keys.enable_hash_index();
+        std::set<std::string> expected;
+        std::srand(17);
+        for(int i = 0; i < 5000; ++i){
+            auto key = std::to_string(std::rand() % 3000);
+            if(std::rand() % 4){
+                keys.insert(key);
+                expected.insert(key);
+            } else {
+                keys.erase(key);
+                expected.erase(key);
+            }
+        }
+        keys.compact(order);
+        EXPECT_TRUE(std::equal(keys.begin(), keys.end(), expected.begin(), expected.end()));
+        for(int key = 0; key < 3000; key += 11){
+            ASSERT_EQ(keys.contains(std::to_string(key)), expected.count(std::to_string(key)) == 1);
+        }
+
+        //  node handles and merge take heap nodes out of the compacted block
+        auto node = keys.extract(*expected.begin());
+        ASSERT_FALSE(node.empty());
+        node.value() = "moved";
+        set<std::string> other;
+        other.insert(std::move(node));
+        other.merge(keys);
+        EXPECT_TRUE(keys.empty());
+        EXPECT_EQ(other.size(), expected.size());
+        other.compact(order);
+        EXPECT_EQ(other.pop_min(), *std::next(expected.begin()));
+        EXPECT_TRUE(other.contains("moved"));
+    }
+
+    set<int> small{3, 1, 2};
+    small.compact();
+    EXPECT_EQ(small.min(), 1);
+    EXPECT_EQ(small.size(), 3);
+}
+
+TEST_F(TestSet, compact_finger_pop){
+    //  popped nodes of a compacted set are copies, the finger must not keep
+    //  pointing at the slot they left
+    set<int> keys;
+    keys.use_finger_cache(true);
+    for(int i = 0; i < 1000; ++i){
+        keys.insert(i);
+    }
+    keys.compact();
+    for(int round = 0; round < 490; ++round){
+        int low = round;
+        int high = 999 - round;
+        keys.find(low);
+        EXPECT_EQ(keys.pop_min(), low);
+        auto it = keys.lower_bound(low + 5);
+        ASSERT_TRUE(it != keys.end());
+        EXPECT_EQ(*it, low + 5);
+        keys.find(high);
+        EXPECT_EQ(keys.pop_max(), high);
+        it = keys.lower_bound(high - 5);
+        ASSERT_TRUE(it != keys.end());
+        EXPECT_EQ(*it, high - 5);
+        ASSERT_TRUE(keys.contains(low + 1));
+    }
+    EXPECT_EQ(keys.size(), 20);
+}
+
+TEST_F(TestSet, split_off){
+    set<int> keys;
+    keys.enable_hash_index();
+    for(int i = 0; i < 1000; ++i){
+        keys.insert(i * 3);
+    }
+    set<int> upper{-1};
+    keys.split_off(1500, upper);
+    EXPECT_EQ(keys.size(), 500);
+    EXPECT_EQ(upper.size(), 500);
+    EXPECT_EQ(keys.max(), 1497);
+    EXPECT_EQ(upper.min(), 1500);
+    EXPECT_TRUE(keys.contains(0));
+    EXPECT_FALSE(keys.contains(1500));
+    EXPECT_FALSE(upper.contains(-1));
+    EXPECT_TRUE(upper.contains(2997));
+
+    //  a cut near the end leaves a part small enough for the inline array
+    set<int> tail;
+    upper.split_off(2990, tail);
+    EXPECT_EQ(upper.size(), 497);
+    std::vector<int> last{2991, 2994, 2997};
+    EXPECT_TRUE(std::equal(tail.begin(), tail.end(), last.begin(), last.end()));
+
+    set<int> small{1, 2, 3, 4};
+    set<int> small_upper;
+    small.split_off(3, small_upper);
+    EXPECT_EQ(small.max(), 2);
+    EXPECT_EQ(small_upper.min(), 3);
+    EXPECT_EQ(small_upper.size(), 2);
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "sharded_set.hpp"
+
+
+TEST(TestShardedSet, random_updates){
+    sharded_set<int> set(64);
+    std::set<int> reference;
+    srand(3);
+    for(int i = 0; i < 20000; ++i){
+        int key = rand() % 5000;
+        if(rand() % 3){
+            EXPECT_EQ(set.insert(key), reference.insert(key).second);
+        } else {
+            EXPECT_EQ(set.erase(key), reference.erase(key) == 1);
+        }
+    }
+    EXPECT_EQ(set.size(), reference.size());
+    EXPECT_GT(set.shard_count(), 1);
+
+    std::vector<int> keys;
+    set.for_each([&keys](int key){ keys.push_back(key); });
+    EXPECT_TRUE(std::equal(keys.begin(), keys.end(), reference.begin(), reference.end()));
+
+    for(int key = -1; key <= 5001; key += 13){
+        EXPECT_EQ(set.contains(key), reference.count(key) == 1);
+        auto found = set.lower_bound(key);
+        auto expected = reference.lower_bound(key);
+        EXPECT_EQ(found.has_value(), expected != reference.end());
+        if(found){
+            EXPECT_EQ(*found, *expected);
+        }
+    }
+
+    keys.clear();
+    set.for_each_in_range(1000, 3000, [&keys](int key){ keys.push_back(key); });
+    EXPECT_TRUE(std::equal(keys.begin(), keys.end(), reference.lower_bound(1000), reference.lower_bound(3000)));
+}
+
+TEST(TestShardedSet, shrink_merges_shards){
+    sharded_set<int> set(32);
+    for(int i = 0; i < 1000; ++i){
+        set.insert(i);
+    }
+    auto shards = set.shard_count();
+    EXPECT_GT(shards, 10);
+    for(int i = 0; i < 1000; ++i){
+        set.erase(i);
+    }
+    EXPECT_TRUE(set.empty());
+    EXPECT_LT(set.shard_count(), shards);
+    EXPECT_FALSE(set.lower_bound(0));
+}
+
+namespace {
+
+//  Comparator with state, which the shards have to share with the directory.
+struct modular_order {
+    int modulus = 1;
+
+    bool operator()(int lhs, int rhs) const {
+        return lhs % modulus != rhs % modulus ? lhs % modulus < rhs % modulus : lhs < rhs;
+    }
+};
+
+}
+
+TEST(TestShardedSet, stateful_compare){
+    modular_order order{7};
+    sharded_set<int, modular_order> set(16, order);
+    std::set<int, modular_order> reference(order);
+    for(int i = 0; i < 500; ++i){
+        int key = (i * 37) % 500;
+        EXPECT_EQ(set.insert(key), reference.insert(key).second);
+    }
+    EXPECT_GT(set.shard_count(), 1);
+    std::vector<int> keys;
+    set.for_each([&keys](int key){ keys.push_back(key); });
+    EXPECT_TRUE(std::equal(keys.begin(), keys.end(), reference.begin(), reference.end()));
+    for(int key = 0; key < 500; key += 3){
+        EXPECT_TRUE(set.contains(key));
+        EXPECT_EQ(*set.lower_bound(key), *reference.lower_bound(key));
+    }
+}
+
+TEST(TestShardedSet, concurrent_writers){
+    sharded_set<int> set(128);
+    std::vector<std::thread> writers;
+    for(int t = 0; t < 4; ++t){
+        writers.emplace_back([&set, t](){
+            for(int i = 0; i < 5000; ++i){
+                set.insert(t * 100000 + i);
+            }
+            for(int i = 0; i < 5000; i += 2){
+                set.erase(t * 100000 + i);
+            }
+        });
+    }
+    for(auto& thread: writers){
+        thread.join();
+    }
+    EXPECT_EQ(set.size(), 4 * 2500);
+    int last = -1;
+    size_t count = 0;
+    set.for_each([&](int key){
+        EXPECT_LT(last, key);
+        EXPECT_EQ(key % 2, 1);
+        last = key;
+        ++count;
+    });
+    EXPECT_EQ(count, set.size());
+}
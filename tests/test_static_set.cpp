@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "static_set.hpp"
+
+
+namespace {
+
+constexpr auto keywords = make_static_set<std::string_view>({"while", "if", "else", "for", "return", "if"});
+constexpr auto codes = make_static_set<int, std::greater<int>>({404, 200, 301, 500, 201});
+
+static_assert(keywords.size() == 5, "duplicates are dropped");
+static_assert(keywords.contains("else") && !keywords.contains("elif"), "lookups are constant expressions");
+static_assert(*keywords.begin() == "else" && *keywords.lower_bound("g") == "if", "keys are sorted");
+static_assert(*codes.begin() == 500 && *codes.upper_bound(301) == 201, "the comparator orders the keys");
+
+}
+
+
+TEST(TestStaticSet, lookups){
+    std::vector<std::string_view> sorted = {"else", "for", "if", "return", "while"};
+    EXPECT_TRUE(std::equal(keywords.begin(), keywords.end(), sorted.begin(), sorted.end()));
+    EXPECT_TRUE(std::equal(keywords.rbegin(), keywords.rend(), sorted.rbegin(), sorted.rend()));
+    for(auto probe: {"", "else", "elsewhere", "for", "g", "while", "zzz"}){
+        std::string_view key = probe;
+        EXPECT_EQ(keywords.lower_bound(key) - keywords.begin(), std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin());
+        EXPECT_EQ(keywords.upper_bound(key) - keywords.begin(), std::upper_bound(sorted.begin(), sorted.end(), key) - sorted.begin());
+        EXPECT_EQ(keywords.count(key), std::count(sorted.begin(), sorted.end(), key));
+    }
+    EXPECT_EQ(keywords.find("zzz"), keywords.end());
+    EXPECT_EQ(*keywords.find("return"), "return");
+}
+
+TEST(TestStaticSet, every_size){
+    //  the fixed step count has to hold at every size, odd and even
+    int values[] = {9, 1, 7, 3, 5, 11, 13, 15, 17};
+    static_set<int, 9> full(values);
+    EXPECT_EQ(full.capacity(), 9);
+    for(size_t size = 0; size <= 9; ++size){
+        std::vector<int> sorted(values, values + size);
+        std::sort(sorted.begin(), sorted.end());
+        int prefix[9] = {};
+        std::copy(values, values + size, prefix);
+        //  the padding zeros collapse into one key
+        static_set<int, 9> set(prefix);
+        if(size < 9){
+            sorted.insert(sorted.begin(), 0);
+        }
+        ASSERT_EQ(set.size(), sorted.size());
+        for(int key = -1; key <= 18; ++key){
+            EXPECT_EQ(set.lower_bound(key) - set.begin(), std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin());
+            EXPECT_EQ(set.contains(key), std::binary_search(sorted.begin(), sorted.end(), key));
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+
+TEST(TestThreadPool, submit){
+    std::atomic<int> done{0};
+    {
+        thread_pool pool(3);
+        EXPECT_EQ(pool.size(), 3);
+        for(int i = 0; i < 100; ++i){
+            pool.submit([&done](){ ++done; });
+        }
+    }
+    EXPECT_EQ(done, 100);
+}
+
+TEST(TestThreadPool, nested_groups){
+    thread_pool pool(2);
+    std::atomic<int> leaves{0};
+    std::function<void(int)> fork = [&](int depth){
+        if(depth == 0){
+            ++leaves;
+            return;
+        }
+        task_group group(pool);
+        group.run([&, depth](){ fork(depth - 1); });
+        fork(depth - 1);
+        group.wait();
+    };
+    fork(10);
+    EXPECT_EQ(leaves, 1024);
+}
+
+TEST(TestThreadPool, exceptions){
+    thread_pool pool(2);
+    task_group group(pool);
+    std::atomic<int> done{0};
+    for(int i = 0; i < 10; ++i){
+        group.run([&done, i](){
+            if(i == 5){
+                throw std::runtime_error("task failed");
+            }
+            ++done;
+        });
+    }
+    EXPECT_THROW(group.wait(), std::runtime_error);
+    EXPECT_EQ(done, 9);
+    group.wait();
+}
+
+TEST(TestThreadPool, parallel_sort){
+    thread_pool pool(3);
+    std::vector<int> values;
+    std::srand(5);
+    for(int i = 0; i < 100000; ++i){
+        values.push_back(std::rand() % 50000);
+    }
+    auto expected = values;
+    std::sort(expected.begin(), expected.end());
+    parallel_sort(values.begin(), values.end(), std::less<int>(), pool, 1000);
+    EXPECT_EQ(values, expected);
+}
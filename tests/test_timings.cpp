@@ -3,6 +3,7 @@
 #include <set>
 #include <chrono>
 #include <iostream>
+#include <vector>
 
 #include "set.hpp"
 
@@ -91,6 +92,56 @@ void test_time_find(const int N){
     std::cout << "set find " << N << " elements: " << dur2.count() << std::endl << std::endl;
 }
 
+void test_time_find_hashed(const int N){
+    std::set<int> std_set;
+    fill_set(std_set, N);
+
+    auto start1 = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < N; ++i){
+        std_set.find(i);
+    }
+    auto end1 = std::chrono::high_resolution_clock::now();
+
+    set<int> set;
+    set.enable_hash_index();
+    fill_set(set, N);
+    auto start2 = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < N; ++i){
+        set.find(i);
+    }
+    auto end2 = std::chrono::high_resolution_clock::now();
+
+    auto dur1 = std::chrono::duration_cast<std::chrono::microseconds>(end1 - start1);
+    auto dur2 = std::chrono::duration_cast<std::chrono::microseconds>(end2 - start2);
+    std::cout << "std::set find " << N << " elements: " << dur1.count() << std::endl;
+    std::cout << "set hashed find " << N << " elements: " << dur2.count() << std::endl << std::endl;
+}
+
+void test_time_find_finger(const int N){
+    std::set<int> std_set;
+    fill_set(std_set, N);
+
+    auto start1 = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < N; ++i){
+        std_set.find(i);
+    }
+    auto end1 = std::chrono::high_resolution_clock::now();
+
+    set<int> set;
+    set.use_finger_cache(true);
+    fill_set(set, N);
+    auto start2 = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < N; ++i){
+        set.find(i);
+    }
+    auto end2 = std::chrono::high_resolution_clock::now();
+
+    auto dur1 = std::chrono::duration_cast<std::chrono::microseconds>(end1 - start1);
+    auto dur2 = std::chrono::duration_cast<std::chrono::microseconds>(end2 - start2);
+    std::cout << "std::set find " << N << " elements: " << dur1.count() << std::endl;
+    std::cout << "set finger find " << N << " elements: " << dur2.count() << std::endl << std::endl;
+}
+
 void test_time_iteration(const int N){
     std::set<int> std_set;
     fill_set(std_set, N);
@@ -114,6 +165,36 @@ void test_time_iteration(const int N){
     std::cout << "set iteration " << N << " elements: " << dur2.count() << std::endl << std::endl;
 }
 
+void test_time_export(const int N){
+    std::set<int> std_set;
+    fill_set(std_set, N);
+    std::vector<int> buffer(256);
+
+    auto start1 = std::chrono::high_resolution_clock::now();
+    auto it = std_set.begin();
+    while(it != std_set.end()){
+        size_t count = 0;
+        for(; it != std_set.end() && count < buffer.size(); ++it){
+            buffer[count++] = *it;
+        }
+    }
+    auto end1 = std::chrono::high_resolution_clock::now();
+
+    set<int> set;
+    fill_set(set, N);
+
+    auto start2 = std::chrono::high_resolution_clock::now();
+    auto cursor = set.make_cursor();
+    while(set.copy_range(cursor, buffer.data(), buffer.size())){
+    }
+    auto end2 = std::chrono::high_resolution_clock::now();
+
+    auto dur1 = std::chrono::duration_cast<std::chrono::microseconds>(end1 - start1);
+    auto dur2 = std::chrono::duration_cast<std::chrono::microseconds>(end2 - start2);
+    std::cout << "std::set export " << N << " elements: " << dur1.count() << std::endl;
+    std::cout << "set copy_range export " << N << " elements: " << dur2.count() << std::endl << std::endl;
+}
+
 TEST(compare, insertion_compare_10){
     test_time_insert(10);
 }
@@ -162,6 +243,14 @@ TEST(compare, find_compare_10000){
     test_time_find(10000);
 }
 
+TEST(compare, find_hashed_compare_10000){
+    test_time_find_hashed(10000);
+}
+
+TEST(compare, find_finger_compare_10000){
+    test_time_find_finger(10000);
+}
+
 TEST(compare, iter_compare_100){
     test_time_iteration(100);
 }
@@ -173,3 +262,7 @@ TEST(compare, iter_compare_1000){
 TEST(compare, iter_compare_10000){
     test_time_iteration(10000);}
 
+TEST(compare, export_compare_100000){
+    test_time_export(100000);
+}
+
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "scratch_file.hpp"
+#include "set.hpp"
+#include "trace.hpp"
+
+
+TEST(TestTrace, round_trip){
+    scratch_file file;
+    std::set<std::string> keys;
+    {
+        trace_writer<std::string> writer(file.path);
+        recording_set<std::set<std::string>> recorder(keys, writer);
+        for(int i = 0; i < 100; ++i){
+            recorder.insert("key" + std::to_string(i));
+        }
+        recorder.erase("key7");
+        EXPECT_EQ(recorder.find("key8"), keys.find("key8"));
+        EXPECT_EQ(recorder.lower_bound("key70"), keys.find("key70"));
+        std::vector<std::string> seen;
+        EXPECT_EQ(recorder.scan("key95", 300, [&](const std::string& key){ seen.push_back(key); }), 5);
+        EXPECT_EQ(seen.front(), "key95");
+    }
+
+    auto trace = read_trace<std::string>(file.path);
+    ASSERT_EQ(trace.size(), 104);
+    EXPECT_EQ(trace[0].op, trace_op::insert);
+    EXPECT_EQ(trace[0].key, "key0");
+    EXPECT_EQ(trace[100].op, trace_op::erase);
+    EXPECT_EQ(trace[100].key, "key7");
+    EXPECT_EQ(trace[101].op, trace_op::find);
+    EXPECT_EQ(trace[102].op, trace_op::lower_bound);
+    EXPECT_EQ(trace[103].op, trace_op::scan);
+    EXPECT_EQ(trace[103].count, 300);
+    EXPECT_EQ(trace[103].key, "key95");
+
+    //  a truncated trace is rejected rather than replayed partially
+    std::ifstream in(file.path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream(file.path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() - 2);
+    EXPECT_THROW(read_trace<std::string>(file.path), std::runtime_error);
+    std::ofstream(file.path, std::ios::binary | std::ios::trunc) << "NOTATRACE";
+    EXPECT_THROW(read_trace<std::string>(file.path), std::runtime_error);
+
+    //  the largest count takes the full 5 bytes, a sixth one is corruption
+    {
+        trace_writer<int> writer(file.path);
+        writer.write(trace_op::scan, 1, UINT32_MAX);
+    }
+    ASSERT_EQ(read_trace<int>(file.path).front().count, UINT32_MAX);
+    std::ofstream(file.path, std::ios::binary | std::ios::trunc)
+        << "SETTRACE" << char(trace_op::scan) << std::string(6, char(0x80)) << char(1) << std::string(4, char(0));
+    EXPECT_THROW(read_trace<int>(file.path), std::runtime_error);
+}
+
+TEST(TestTrace, replay_backends){
+    std::vector<trace_event<int>> trace;
+    std::srand(7);
+    for(int i = 0; i < 20000; ++i){
+        auto key = std::rand() % 2000;
+        auto op = static_cast<trace_op>(std::rand() % trace_op_count);
+        trace.push_back({op, key, op == trace_op::scan ? uint32_t(std::rand() % 50) : 0});
+    }
+
+    std::set<int> reference;
+    set<int> tree;
+    auto expected = replay(trace, reference);
+    auto actual = replay(trace, tree);
+    EXPECT_EQ(actual.operations, trace.size());
+    EXPECT_EQ(actual.checksum, expected.checksum);
+    EXPECT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin(), reference.end()));
+
+    size_t timed = 0;
+    for(const auto& latency: actual.latency){
+        timed += latency.count();
+        EXPECT_LE(latency.percentile(0.5), latency.percentile(0.99));
+        EXPECT_LE(latency.percentile(0.99), latency.percentile(0.999));
+        EXPECT_LE(latency.percentile(0.999), latency.max());
+    }
+    EXPECT_EQ(timed, trace.size());
+    EXPECT_GT(actual.throughput(), 0);
+}
+
+TEST(TestTrace, histogram_percentiles){
+    latency_histogram histogram;
+    EXPECT_EQ(histogram.percentile(0.5), 0);
+    for(uint64_t value = 1; value <= 10000; ++value){
+        histogram.record(value);
+    }
+    EXPECT_EQ(histogram.count(), 10000);
+    EXPECT_EQ(histogram.max(), 10000);
+    EXPECT_EQ(histogram.total(), 10000ull * 10001 / 2);
+    //  buckets are within 1/16 of their values
+    for(double fraction: {0.5, 0.9, 0.99, 0.999}){
+        double exact = fraction * 10000;
+        EXPECT_GE(histogram.percentile(fraction), exact);
+        EXPECT_LE(histogram.percentile(fraction), exact * 1.0625 + 1);
+    }
+    EXPECT_EQ(histogram.percentile(1.0), 10000);
+
+    latency_histogram small;
+    for(uint64_t value = 0; value < 16; ++value){
+        small.record(value);
+    }
+    EXPECT_EQ(small.percentile(0.5), 8);
+    small += histogram;
+    EXPECT_EQ(small.count(), 10016);
+    EXPECT_EQ(small.max(), 10000);
+}
@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "tree.hpp"
 
@@ -35,8 +40,8 @@ TEST_F(TestTree, default_constr){
     EXPECT_EQ(t_default.size(), 0);
     EXPECT_TRUE(t_default.empty());
 
-    EXPECT_EQ(t_default.min_node(), std::shared_ptr<Tree<int>::Node>());
-    EXPECT_EQ(t_default.max_node(), std::shared_ptr<Tree<int>::Node>());
+    EXPECT_EQ(t_default.min_node(), nullptr);
+    EXPECT_EQ(t_default.max_node(), nullptr);
 }
 
 TEST_F(TestTree, copy_constr){
@@ -97,6 +102,44 @@ TEST_F(TestTree, lower_bound){
     EXPECT_EQ(t3_int.lower_bound(4), nullptr);
 }
 
+TEST_F(TestTree, upper_bound){
+    EXPECT_EQ(t3_int.upper_bound(-1)->key, 0);
+    EXPECT_EQ(t3_int.upper_bound(0)->key, 1);
+    EXPECT_EQ(t3_int.upper_bound(2), nullptr);
+}
+
+TEST_F(TestTree, visit_range){
+    std::vector<int> keys;
+    t4_int.visit_range(1, 3, [&keys](int key){
+        keys.push_back(key);
+        return true;
+    });
+    EXPECT_EQ(keys, std::vector<int>({1, 2}));
+}
+
+TEST_F(TestTree, node_layout){
+    EXPECT_LE(sizeof(Tree<int>::Node), 32);
+    EXPECT_LE(sizeof(Tree<double>::Node), 40);
+}
+
+TEST_F(TestTree, node_layout_aggregate){
+    //  no_aggregate takes no room, a real aggregate only its own value
+    EXPECT_LE(sizeof(Tree<int>::Node), 32);
+    EXPECT_EQ(sizeof(Tree<int, std::less<int>, avl_balance, sum_aggregate<long>>::Node),
+              sizeof(Tree<int>::Node) + sizeof(long));
+}
+
+TEST_F(TestTree, copy_assignment){
+    Tree<int> test;
+    test.insert(100);
+    test = t4_int;
+    test = test;
+    EXPECT_EQ(test.size(), t4_int.size());
+    EXPECT_EQ(test.search(100), nullptr);
+    EXPECT_NE(test.search(3), t4_int.search(3));
+    EXPECT_EQ(test.search(3)->key, 3);
+}
+
 TEST_F(TestTree, min_node){
     EXPECT_EQ(t3_int.min_node()->key, 0);
     EXPECT_EQ(t4_str_cmp.min_node()->key, "2022");
@@ -109,3 +152,527 @@ TEST_F(TestTree, max_node){
 
 
 
+
+
+//  Every balancing policy must keep the tree ordered, keep parent links intact
+//  and hold its own shape invariant under a random mix of updates.
+
+template <class Node>
+long checked_height(const Node* node, const avl_balance&) {
+    if(!node){
+        return 0;
+    }
+    auto left = checked_height(node->left, avl_balance());
+    auto right = checked_height(node->right, avl_balance());
+    EXPECT_LE(std::abs(left - right), MAX_IMBALANCE);
+    EXPECT_EQ(long(node->height), std::max(left, right) + 1);
+    return node->height;
+}
+
+template <class Node>
+long checked_height(const Node* node, const relaxed_avl_balance& balance) {
+    if(!node){
+        return 0;
+    }
+    auto left = checked_height(node->left, balance);
+    auto right = checked_height(node->right, balance);
+    EXPECT_LE(std::abs(left - right), balance.bound());
+    EXPECT_EQ(long(node->height), std::max(left, right) + 1);
+    return node->height;
+}
+
+template <class Node>
+long checked_height(const Node* node, const red_black_balance&) {
+    if(!node){
+        return 0;
+    }
+    for(auto& child: {node->left, node->right}){
+        auto diff = long(node->height) - checked_height(child, red_black_balance());
+        EXPECT_TRUE(diff == 0 || diff == 1);
+        if(diff == 0){
+            EXPECT_TRUE(!child->left || child->height != child->left->height);
+            EXPECT_TRUE(!child->right || child->height != child->right->height);
+        }
+    }
+    return node->height;
+}
+
+template <class Node>
+long checked_height(const Node* node, const wavl_balance&) {
+    if(!node){
+        return 0;
+    }
+    for(auto& child: {node->left, node->right}){
+        auto diff = long(node->height) - checked_height(child, wavl_balance());
+        EXPECT_TRUE(diff == 1 || diff == 2);
+    }
+    if(!node->left && !node->right){
+        EXPECT_EQ(node->height, 1);
+    }
+    return node->height;
+}
+
+template <class Node>
+void check_links(const Node* node) {
+    for(auto& child: {node->left, node->right}){
+        if(child){
+            EXPECT_EQ(child->parent, node);
+            check_links(child);
+        }
+    }
+}
+
+template <class Balance>
+class TestBalance : public ::testing::Test{};
+
+using balance_policies = ::testing::Types<avl_balance, relaxed_avl_balance, red_black_balance, wavl_balance>;
+TYPED_TEST_SUITE(TestBalance, balance_policies);
+
+TYPED_TEST(TestBalance, random_updates){
+    TypeParam balance;
+    Tree<int, std::less<int>, TypeParam> tree(balance);
+    std::set<int> expected;
+    std::srand(42);
+
+    for(int i = 0; i < 5000; ++i){
+        int key = std::rand() % 1000;
+        if(std::rand() % 3){
+            tree.insert(key);
+            expected.insert(key);
+        } else {
+            tree.erase(key);
+            expected.erase(key);
+        }
+        if(i % 500 == 0 && tree.root()){
+            checked_height(tree.root(), balance);
+            check_links(tree.root());
+        }
+    }
+
+    checked_height(tree.root(), balance);
+    check_links(tree.root());
+    EXPECT_EQ(tree.size(), expected.size());
+    EXPECT_EQ(tree.min_node()->key, *expected.begin());
+    EXPECT_EQ(tree.max_node()->key, *expected.rbegin());
+    for(int key = 0; key < 1000; ++key){
+        EXPECT_EQ(tree.search(key) != nullptr, expected.count(key) == 1);
+    }
+
+    for(int key: std::set<int>(expected)){
+        tree.erase(key);
+        expected.erase(key);
+    }
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(tree.root(), nullptr);
+}
+
+TYPED_TEST(TestBalance, range_erase){
+    TypeParam balance;
+    Tree<int, std::less<int>, TypeParam> tree(balance);
+    std::set<int> expected;
+    std::srand(7);
+
+    for(int round = 0; round < 40; ++round){
+        for(int i = 0; i < 300; ++i){
+            int key = std::rand() % 5000;
+            tree.insert(key);
+            expected.insert(key);
+        }
+        int lo = std::rand() % 5000;
+        int hi = lo + std::rand() % 800;
+        auto first = expected.lower_bound(lo);
+        auto last = expected.lower_bound(hi);
+        EXPECT_EQ(tree.erase(lo, hi), size_t(std::distance(first, last)));
+        expected.erase(first, last);
+
+        checked_height(tree.root(), balance);
+        check_links(tree.root());
+        ASSERT_EQ(tree.size(), expected.size());
+    }
+
+    EXPECT_EQ(tree.erase_if([](int key){ return key % 3 == 0; }), size_t(std::count_if(
+        expected.begin(), expected.end(), [](int key){ return key % 3 == 0; })));
+    for(auto it = expected.begin(); it != expected.end();){
+        it = *it % 3 == 0 ? expected.erase(it) : std::next(it);
+    }
+    checked_height(tree.root(), balance);
+    check_links(tree.root());
+
+    EXPECT_EQ(tree.erase_from(2500), size_t(std::distance(expected.lower_bound(2500), expected.end())));
+    expected.erase(expected.lower_bound(2500), expected.end());
+    checked_height(tree.root(), balance);
+    check_links(tree.root());
+
+    ASSERT_EQ(tree.size(), expected.size());
+    EXPECT_EQ(tree.min_node()->key, *expected.begin());
+    EXPECT_EQ(tree.max_node()->key, *expected.rbegin());
+    auto node = tree.min_node();
+    for(int key: expected){
+        ASSERT_EQ(node->key, key);
+        node = tree.next(node);
+    }
+    EXPECT_EQ(node, nullptr);
+
+    EXPECT_EQ(tree.erase_from(0), expected.size());
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(tree.root(), nullptr);
+}
+
+TYPED_TEST(TestBalance, assign_sorted){
+    thread_pool pool(3);
+    std::vector<int> keys;
+    for(int i = 0; i < 50000; ++i){
+        keys.push_back(i * 2);
+    }
+    TypeParam balance;
+    Tree<int, std::less<int>, TypeParam> tree(balance);
+    tree.insert(7);
+    tree.assign_sorted(keys.data(), keys.data() + keys.size(), pool);
+
+    checked_height(tree.root(), balance);
+    check_links(tree.root());
+    EXPECT_EQ(tree.size(), keys.size());
+    EXPECT_EQ(tree.min_node()->key, 0);
+    EXPECT_EQ(tree.max_node()->key, 99998);
+    EXPECT_EQ(tree.search(7), nullptr);
+    EXPECT_NE(tree.search(4242), nullptr);
+
+    //  the built tree keeps balancing under updates
+    for(int i = 1; i < 2000; i += 2){
+        tree.insert(i);
+        tree.erase(i * 7 + 1);
+    }
+    checked_height(tree.root(), balance);
+    check_links(tree.root());
+
+    tree.assign_sorted(keys.data(), keys.data(), pool);
+    EXPECT_TRUE(tree.empty());
+}
+
+template <class Node>
+long checked_sum(const Node* node) {
+    if(!node){
+        return 0;
+    }
+    auto sum = checked_sum(node->left) + node->key + checked_sum(node->right);
+    EXPECT_EQ(node->aggregate, sum);
+    return sum;
+}
+
+TYPED_TEST(TestBalance, aggregate){
+    TypeParam balance;
+    Tree<int, std::less<int>, TypeParam, sum_aggregate<long>> tree(balance);
+    std::set<int> expected;
+    std::srand(11);
+
+    for(int i = 0; i < 4000; ++i){
+        int key = std::rand() % 2000;
+        if(std::rand() % 3){
+            tree.insert(key);
+            expected.insert(key);
+        } else {
+            tree.erase(key);
+            expected.erase(key);
+        }
+        if(i % 400 == 0){
+            checked_sum(tree.root());
+        }
+    }
+    tree.erase(300, 700);
+    expected.erase(expected.lower_bound(300), expected.lower_bound(700));
+    tree.erase_if([](int key){ return key % 5 == 0; });
+    for(auto it = expected.begin(); it != expected.end();){
+        it = *it % 5 == 0 ? expected.erase(it) : std::next(it);
+    }
+    auto copy = tree;
+    checked_sum(copy.root());
+
+    for(int i = 0; i < 200; ++i){
+        int lo = std::rand() % 2100 - 50;
+        int hi = lo + std::rand() % 1000;
+        long sum = 0;
+        for(auto it = expected.lower_bound(lo); it != expected.lower_bound(hi); ++it){
+            sum += *it;
+        }
+        ASSERT_EQ(tree.aggregate(lo, hi), sum);
+    }
+    EXPECT_EQ(tree.aggregate(), checked_sum(tree.root()));
+    EXPECT_EQ(tree.aggregate(5, 5), 0);
+}
+
+TYPED_TEST(TestBalance, extract_extremes){
+    TypeParam balance;
+    Tree<int, std::less<int>, TypeParam, sum_aggregate<long>> tree(balance);
+    std::set<int> expected;
+    std::srand(5);
+    for(int i = 0; i < 3000; ++i){
+        int key = std::rand() % 10000;
+        tree.insert(key);
+        expected.insert(key);
+    }
+
+    for(int i = 0; !expected.empty(); ++i){
+        //  refill now and then so that the extremes sit at varying depths
+        if(i % 100 == 0){
+            for(int j = 0; j < 20; ++j){
+                int key = std::rand() % 10000;
+                tree.insert(key);
+                expected.insert(key);
+            }
+        }
+        auto node = i % 3 ? tree.extract_min() : tree.extract_max();
+        auto key = i % 3 ? *expected.begin() : *expected.rbegin();
+        ASSERT_EQ(node->key, key);
+        EXPECT_EQ(node->parent, nullptr);
+        EXPECT_EQ(node->left, nullptr);
+        EXPECT_EQ(node->right, nullptr);
+        delete node;
+        expected.erase(key);
+
+        ASSERT_EQ(tree.size(), expected.size());
+        if((i % 50 == 0 || expected.size() < 10) && tree.root()){
+            checked_height(tree.root(), balance);
+            check_links(tree.root());
+            checked_sum(tree.root());
+        }
+        if(!expected.empty()){
+            ASSERT_EQ(tree.min_node()->key, *expected.begin());
+            ASSERT_EQ(tree.max_node()->key, *expected.rbegin());
+        }
+    }
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(tree.root(), nullptr);
+    EXPECT_EQ(tree.min_node(), nullptr);
+    EXPECT_EQ(tree.max_node(), nullptr);
+    EXPECT_EQ(tree.extract_min(), nullptr);
+    EXPECT_EQ(tree.extract_max(), nullptr);
+}
+
+template <class Node>
+void shape(const Node* node, std::vector<int>& out) {
+    if(!node){
+        out.push_back(-1);
+        return;
+    }
+    out.push_back(node->key);
+    out.push_back(node->height);
+    shape(node->left, out);
+    shape(node->right, out);
+}
+
+TYPED_TEST(TestBalance, compact){
+    for(auto order: {compact_order::in_order, compact_order::van_emde_boas}){
+        TypeParam balance;
+        Tree<int, std::less<int>, TypeParam, sum_aggregate<long>> tree(balance);
+        std::set<int> expected;
+        std::srand(13);
+        for(int i = 0; i < 6000; ++i){
+            int key = std::rand() % 4000;
+            if(std::rand() % 3){
+                tree.insert(key);
+                expected.insert(key);
+            } else {
+                tree.erase(key);
+                expected.erase(key);
+            }
+        }
+        std::vector<int> before;
+        shape(tree.root(), before);
+        tree.compact(order);
+        std::vector<int> after;
+        shape(tree.root(), after);
+        EXPECT_EQ(before, after);
+        check_links(tree.root());
+        checked_sum(tree.root());
+        ASSERT_EQ(tree.min_node()->key, *expected.begin());
+        ASSERT_EQ(tree.max_node()->key, *expected.rbegin());
+
+        //  one block: in key order consecutive nodes are adjacent, in van Emde
+        //  Boas order the root comes first
+        auto first = tree.min_node();
+        if(order == compact_order::in_order){
+            for(auto node = first; tree.next(node); node = tree.next(node)){
+                ASSERT_EQ(tree.next(node), node + 1);
+            }
+        } else {
+            first = tree.root();
+            for(auto node = tree.min_node(); node; node = tree.next(node)){
+                ASSERT_GE(node, first);
+                ASSERT_LT(node, first + expected.size());
+            }
+        }
+
+        //  the tree keeps working on the block, handing out heap nodes
+        for(int i = 0; i < 3000; ++i){
+            int key = std::rand() % 4000;
+            switch(std::rand() % 4){
+                case 0:
+                    tree.insert(key);
+                    expected.insert(key);
+                    break;
+                case 1:
+                    tree.erase(key);
+                    expected.erase(key);
+                    break;
+                case 2:
+                    delete tree.extract(key);
+                    expected.erase(key);
+                    break;
+                default:
+                    if(!expected.empty()){
+                        delete tree.extract_min();
+                        expected.erase(expected.begin());
+                    }
+            }
+        }
+        checked_height(tree.root(), balance);
+        check_links(tree.root());
+        checked_sum(tree.root());
+
+        tree.compact(order);
+        std::vector<int> taken;
+        tree.extract_if([](int key){ return key % 3 == 0; }, [&taken](auto node){
+            taken.push_back(node->key);
+            delete node;
+        });
+        tree.erase_if([](int key){ return key % 3 == 1; });
+        for(auto it = expected.begin(); it != expected.end();){
+            it = *it % 3 != 2 ? expected.erase(it) : std::next(it);
+        }
+        ASSERT_EQ(tree.size(), expected.size());
+
+        auto copy = tree;
+        tree.compact(order);
+        tree = copy;
+        auto moved = std::move(copy);
+        moved.swap(tree);
+        checked_height(tree.root(), balance);
+        check_links(tree.root());
+        auto node = tree.min_node();
+        for(int key: expected){
+            ASSERT_EQ(node->key, key);
+            node = tree.next(node);
+        }
+        tree.clear();
+        tree.compact(order);
+        EXPECT_TRUE(tree.empty());
+    }
+}
+
+TYPED_TEST(TestBalance, split_off){
+    for(bool compacted: {false, true}){
+        TypeParam balance;
+        Tree<int, std::less<int>, TypeParam, sum_aggregate<long>> tree(balance);
+        std::set<int> expected;
+        std::srand(19);
+        for(int i = 0; i < 4000; ++i){
+            int key = std::rand() % 6000;
+            tree.insert(key);
+            expected.insert(key);
+        }
+        if(compacted){
+            tree.compact();
+        }
+
+        //  cut the upper part off again and again, then join it back
+        Tree<int, std::less<int>, TypeParam, sum_aggregate<long>> upper(balance);
+        for(int cut: {5000, 3100, 2999, 0, 7000}){
+            upper.insert(-1);
+            tree.split_off(cut, upper);
+            auto bound = expected.lower_bound(cut);
+            ASSERT_EQ(tree.size(), size_t(std::distance(expected.begin(), bound)));
+            ASSERT_EQ(upper.size(), size_t(std::distance(bound, expected.end())));
+            for(auto part: {&tree, &upper}){
+                if(part->root()){
+                    checked_height(part->root(), balance);
+                    check_links(part->root());
+                    checked_sum(part->root());
+                    EXPECT_EQ(part->root()->parent, nullptr);
+                }
+            }
+            auto node = tree.min_node();
+            for(auto it = expected.begin(); it != bound; ++it){
+                ASSERT_EQ(node->key, *it);
+                node = tree.next(node);
+            }
+            EXPECT_EQ(node, nullptr);
+            node = upper.min_node();
+            for(auto it = bound; it != expected.end(); ++it){
+                ASSERT_EQ(node->key, *it);
+                node = upper.next(node);
+            }
+            EXPECT_EQ(node, nullptr);
+
+            //  the moved nodes belong to upper now and are freed by it
+            for(auto moved = upper.min_node(); moved; moved = upper.next(moved)){
+                tree.insert(moved->key);
+            }
+            upper.clear();
+            ASSERT_EQ(tree.size(), expected.size());
+        }
+    }
+}
+
+TEST(TestBalancePolicy, relaxed_bound){
+    relaxed_avl_balance balance(3);
+    Tree<int, std::less<int>, relaxed_avl_balance> tree(balance);
+    Tree<int> strict;
+    for(int i = 0; i < 1000; ++i){
+        tree.insert(i);
+        strict.insert(i);
+    }
+    checked_height(tree.root(), balance);
+    EXPECT_GE(tree.root()->height, strict.root()->height);
+}
+
+TEST(TestKeyPrefix, string_lookups){
+    //  short keys, shared prefixes longer than the cached eight bytes, zero
+    //  bytes and bytes above 0x7f all have to order as std::string does
+    std::vector<std::string> pieces = {"", "a", std::string(1, '\0'), "\xff", "prefix__", "prefix__x", "zz"};
+    auto random_key = [&pieces](){
+        std::string key;
+        for(int i = std::rand() % 4; i > 0; --i){
+            key += pieces[std::rand() % pieces.size()];
+        }
+        return key;
+    };
+    Tree<std::string> tree;
+    std::set<std::string> expected;
+    std::srand(12);
+    for(int i = 0; i < 3000; ++i){
+        auto key = random_key();
+        tree.insert(key);
+        expected.insert(key);
+    }
+    EXPECT_EQ(tree.size(), expected.size());
+    for(int i = 0; i < 3000; ++i){
+        auto key = random_key();
+        auto found = tree.search(key);
+        EXPECT_EQ(found != nullptr, expected.count(key) == 1);
+        auto lower = tree.lower_bound(key);
+        auto expected_lower = expected.lower_bound(key);
+        ASSERT_EQ(lower == nullptr, expected_lower == expected.end());
+        if(lower){
+            EXPECT_EQ(lower->key, *expected_lower);
+        }
+        auto upper = tree.upper_bound(key);
+        auto expected_upper = expected.upper_bound(key);
+        ASSERT_EQ(upper == nullptr, expected_upper == expected.end());
+        if(upper){
+            EXPECT_EQ(upper->key, *expected_upper);
+        }
+    }
+
+    //  a detached node gets its prefix refreshed when it goes back in
+    auto node = tree.extract(*expected.begin());
+    node->key = "\xff\xff\xff\xff\xff\xff\xff\xff\xff";
+    tree.insert(node);
+    EXPECT_EQ(tree.search(node->key), node);
+    EXPECT_EQ(tree.max_node(), node);
+}
+
+TEST(TestKeyPrefix, node_layout){
+    //  only string keys under their natural order pay for the prefix
+    EXPECT_EQ(sizeof(Tree<std::string>::Node), sizeof(Tree<std::string, std::greater<std::string>>::Node) + 16);
+    EXPECT_EQ(sizeof(Tree<int>::Node), sizeof(Tree<int, std::greater<int>>::Node));
+}
@@ -0,0 +1,99 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+
+#include "set.hpp"
+#include "trace.hpp"
+
+
+//  Records and replays set traces over int64_t keys.
+//
+//      trace_replay record <file> [operations] [seed]
+//          writes a synthetic trace with skewed keys through recording_set
+//      trace_replay replay <file>
+//          runs the trace against std::set and the set variants below and
+//          prints throughput and p50/p99/p999 latency per operation
+
+
+using key_type = int64_t;
+
+
+static int record(const char* path, size_t operations, unsigned seed) {
+    std::set<key_type> keys;
+    trace_writer<key_type> writer(path);
+    recording_set<std::set<key_type>> recorder(keys, writer);
+    std::mt19937_64 random(seed);
+    //  a few hot ranges take most of the traffic, like real key spaces
+    std::geometric_distribution<key_type> hot(1e-4);
+    std::uniform_int_distribution<key_type> cold(0, key_type(1) << 30);
+    std::uniform_int_distribution<int> kind(0, 99);
+    for(size_t i = 0; i < operations; ++i){
+        auto key = kind(random) < 80 ? hot(random) : cold(random);
+        auto roll = kind(random);
+        if(roll < 30){
+            recorder.insert(key);
+        }else if(roll < 40){
+            recorder.erase(key);
+        }else if(roll < 75){
+            recorder.find(key);
+        }else if(roll < 95){
+            recorder.lower_bound(key);
+        }else{
+            recorder.scan(key, 1 + kind(random), [](key_type){});
+        }
+    }
+    writer.flush();
+    return 0;
+}
+
+
+template <class Set>
+static void run(const char* name, const std::vector<trace_event<key_type>>& trace, Set set) {
+    auto result = replay(trace, set);
+    std::printf("%-20s %12.0f ops/s  checksum %016llx\n",
+                name, result.throughput(), static_cast<unsigned long long>(result.checksum));
+    for(size_t op = 0; op < trace_op_count; ++op){
+        const auto& latency = result.latency[op];
+        if(latency.count() == 0){
+            continue;
+        }
+        std::printf("    %-12s %10zu ops  p50 %8llu ns  p99 %8llu ns  p999 %8llu ns  max %8llu ns\n",
+                    trace_op_name(static_cast<trace_op>(op)), latency.count(),
+                    static_cast<unsigned long long>(latency.percentile(0.5)),
+                    static_cast<unsigned long long>(latency.percentile(0.99)),
+                    static_cast<unsigned long long>(latency.percentile(0.999)),
+                    static_cast<unsigned long long>(latency.max()));
+    }
+}
+
+
+static int replay_all(const char* path) {
+    auto trace = read_trace<key_type>(path);
+    std::printf("%zu operations from %s\n", trace.size(), path);
+    run("std::set", trace, std::set<key_type>());
+    run("set", trace, set<key_type>());
+    run("set<red_black>", trace, set<key_type, std::less<key_type>, red_black_balance>());
+    set<key_type> hashed;
+    hashed.enable_hash_index();
+    run("set+hash_index", trace, std::move(hashed));
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    if(argc >= 3 && std::strcmp(argv[1], "record") == 0){
+        auto operations = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1000000;
+        auto seed = argc >= 5 ? unsigned(std::strtoul(argv[4], nullptr, 10)) : 1u;
+        return record(argv[2], operations, seed);
+    }
+    if(argc >= 3 && std::strcmp(argv[1], "replay") == 0){
+        return replay_all(argv[2]);
+    }
+    std::fprintf(stderr, "usage: %s record <file> [operations] [seed]\n"
+                         "       %s replay <file>\n", argv[0], argv[0]);
+    return 2;
+}